@@ -0,0 +1,95 @@
+/*
+**  bfloat16 storage for the mixed precision variants of part 2 and part 4.
+**
+**  A bf16 is the upper half of a float: same exponent range, 8 bits of
+**  mantissa. Conversions round to nearest even in software. When the target
+**  has AVX512-BF16 (-march=native on Cooper Lake, Sapphire Rapids, Zen 4),
+**  vdpbf16ps multiplies bf16 pairs and accumulates in float, otherwise
+**  the values are widened to float with a shift.
+*/
+
+#ifndef TP_OPENMP_BF16_HPP
+#define TP_OPENMP_BF16_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#ifdef __AVX512BF16__
+#include <immintrin.h>
+#endif
+
+struct bf16
+{
+  uint16_t bits;
+
+  bf16() = default;
+
+  explicit bf16(float f)
+  {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7fffffffu) > 0x7f800000u)
+    {
+      bits = (uint16_t)((u >> 16) | 0x40); // keep NaN quiet
+      return;
+    }
+    u += 0x7fffu + ((u >> 16) & 1);
+    bits = (uint16_t)(u >> 16);
+  }
+
+  operator float() const
+  {
+    uint32_t u = (uint32_t)bits << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+};
+
+// a . b over n elements of storage type T, accumulated in Acc
+template <typename T, typename Acc>
+inline Acc dot(const T *a, const T *b, size_t n)
+{
+  Acc sum = 0;
+  #pragma omp simd reduction(+ : sum)
+  for (size_t i = 0; i < n; i++)
+  {
+    sum += (Acc)a[i] * (Acc)b[i];
+  }
+  return sum;
+}
+
+#ifdef __AVX512BF16__
+// 32 products per instruction, two accumulators to hide the latency, the
+// last n % 32 elements are loaded masked (zeros do not change the sum)
+template <>
+inline float dot<bf16, float>(const bf16 *a, const bf16 *b, size_t n)
+{
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64)
+  {
+    acc0 = _mm512_dpbf16_ps(acc0, (__m512bh)_mm512_loadu_si512(a + i), (__m512bh)_mm512_loadu_si512(b + i));
+    acc1 = _mm512_dpbf16_ps(acc1, (__m512bh)_mm512_loadu_si512(a + i + 32), (__m512bh)_mm512_loadu_si512(b + i + 32));
+  }
+  for (; i < n; i += 32)
+  {
+    __mmask32 m = n - i >= 32 ? (__mmask32)0xffffffffu : (__mmask32)((1u << (n - i)) - 1);
+    acc0 = _mm512_dpbf16_ps(acc0, (__m512bh)_mm512_maskz_loadu_epi16(m, a + i), (__m512bh)_mm512_maskz_loadu_epi16(m, b + i));
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+#endif
+
+// Whether dot<bf16, float> runs on the AVX512-BF16 instructions
+inline const char *bf16_kernel_name()
+{
+#ifdef __AVX512BF16__
+  return "AVX512-BF16";
+#else
+  return "software";
+#endif
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+**  Freivalds' check of a matrix product C = A * B for part 4.
+**
+**  For a random vector v, A (B v) must equal C v. That is three matrix-vector
+**  products, O(N P + P M + N M) instead of the O(N M P) of recomputing C.
+**  v has random +-1 entries, so a wrong C passes one trial with probability
+**  at most 1/2 and k trials miss it with probability at most 2^-k.
+**
+**  In floating point both sides carry rounding errors: the difference of row
+**  i is divided by (|A| (|B| |v|))_i, the sum of the magnitudes that were
+**  added, and compared with a tolerance. (P + M) times the unit roundoff
+**  bounds it in the worst case, but the roundings behave like a random walk
+**  and the residuals seen are about sqrt(P + M) u, four orders of magnitude
+**  lower on 1000 x 1000 products. The default tolerance is 4 sqrt(P + M) u.
+**  Correlated roundings (a constant matrix) grow faster, about 0.005 (P + M) u,
+**  and reach it near P + M = 600000; -tol sets another value for such runs.
+**
+**  Smallest error caught: the 1/2 above holds for a C whose largest error
+**  in some row i exceeds tolerance * (|A| |B| 1)_i (flipping the sign of v
+**  on that element moves the row difference by twice the error, so at most
+**  one of the two signs hides it). A single wrong element above that is
+**  caught by every trial; smaller errors may pass, however many trials.
+*/
+
+#ifndef TP_OPENMP_FREIVALDS_HPP
+#define TP_OPENMP_FREIVALDS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include "generator.hpp"
+
+// Residual above which C is wrong, u the unit roundoff of the accumulation
+// of C (2^-53 for double, 2^-24 for float). A run can pass its own value
+// instead, -tol in part 4.
+inline double freivalds_tolerance(size_t M, size_t P, double u)
+{
+  return 4.0 * sqrt((double)(M + P)) * u;
+}
+
+// Largest relative residual over trials random vectors. A and B are read
+// through a(i, k) and b(k, j), so a stored matrix, another precision or a
+// generated one can be checked alike; C is N x M, row-major.
+template <typename GetA, typename GetB, typename TC>
+double freivalds(GetA a, GetB b, const TC *C, size_t N, size_t M, size_t P, int trials, uint64_t seed)
+{
+  std::vector<double> v(M), Bv(P), Bv_abs(P);
+  double worst = 0;
+
+  for (int t = 0; t < trials; t++)
+  {
+    #pragma omp parallel for schedule(static)
+    for (size_t j = 0; j < M; j++)
+    {
+      v[j] = gen_uniform(seed, t, j) < 0 ? -1.0 : 1.0;
+    }
+
+    // B v and |B| |v|
+    #pragma omp parallel for schedule(static)
+    for (size_t k = 0; k < P; k++)
+    {
+      double sum = 0, sum_abs = 0;
+      #pragma omp simd reduction(+ : sum, sum_abs)
+      for (size_t j = 0; j < M; j++)
+      {
+        double bkj = b(k, j);
+        sum += bkj * v[j];
+        sum_abs += fabs(bkj);
+      }
+      Bv[k] = sum;
+      Bv_abs[k] = sum_abs;
+    }
+
+    // A (B v) against C v, row by row
+    #pragma omp parallel for schedule(static) reduction(max : worst)
+    for (size_t i = 0; i < N; i++)
+    {
+      double abv = 0, bound = 0;
+      #pragma omp simd reduction(+ : abv, bound)
+      for (size_t k = 0; k < P; k++)
+      {
+        double aik = a(i, k);
+        abv += aik * Bv[k];
+        bound += fabs(aik) * Bv_abs[k];
+      }
+      const TC *c = C + i * M;
+      double cv = 0;
+      #pragma omp simd reduction(+ : cv)
+      for (size_t j = 0; j < M; j++)
+      {
+        cv += (double)c[j] * v[j];
+      }
+      double residual = fabs(abv - cv);
+      if (bound > 0)
+        residual /= bound;
+      if (residual != residual)
+        residual = INFINITY; // a NaN in C fails the check
+      worst = worst > residual ? worst : residual;
+    }
+  }
+
+  return worst;
+}
+
+#endif
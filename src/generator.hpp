@@ -0,0 +1,150 @@
+/*
+**  Input generators for the part 2 and part 4 matrices.
+**
+**     constant   every element is value (the 1 of part 2, AVAL/BVAL of part 4)
+**     random     uniform in [-1, 1), counter-based: the element (i, j) is a
+**                hash of (seed, i, j), so any thread can compute any element
+**                in any order and always gets the same matrix
+**     banded     value / (1 + |i - j|) for |i - j| <= band, 0 elsewhere
+**     toeplitz   constant along the diagonals, t(i - j) random in [-1, 1)
+**
+**  A matrix is either filled by generate() in parallel, each row first
+**  touched by the thread that reads it with a static schedule, or never
+**  stored and evaluated by the kernel with at<KIND>(i, j).
+*/
+
+#ifndef TP_OPENMP_GENERATOR_HPP
+#define TP_OPENMP_GENERATOR_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+enum generator_kind
+{
+  GEN_CONSTANT,
+  GEN_RANDOM,
+  GEN_BANDED,
+  GEN_TOEPLITZ
+};
+
+static const char *generator_names[] = {"constant", "random", "banded", "toeplitz"};
+
+// Parses a -gen argument, exits on an unknown name
+inline int parse_generator(const char *name)
+{
+  for (int k = GEN_CONSTANT; k <= GEN_TOEPLITZ; k++)
+  {
+    if (strcmp(name, generator_names[k]) == 0)
+      return k;
+  }
+  printf("  Unknown generator %s (constant, random, banded or toeplitz)\n", name);
+  exit(1);
+}
+
+// splitmix64 finalizer
+inline uint64_t gen_mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [-1, 1) from the 53 high bits of the hash of (seed, a, b)
+inline double gen_uniform(uint64_t seed, uint64_t a, uint64_t b)
+{
+  uint64_t h = gen_mix(gen_mix(seed + 0x9e3779b97f4a7c15ull * (a + 1)) + b);
+  return (double)(h >> 11) * 0x1.0p-52 - 1.0;
+}
+
+struct generator
+{
+  int kind = GEN_CONSTANT;
+  double value = 1;
+  uint64_t seed = 42;
+  size_t band = 2;
+
+  // Element (i, j), the kind is a template argument so that the kernels
+  // evaluating the matrix on the fly have no switch in their inner loop
+  template <int KIND>
+  inline double at(size_t i, size_t j) const
+  {
+    if (KIND == GEN_RANDOM)
+      return gen_uniform(seed, i, j);
+    if (KIND == GEN_BANDED)
+    {
+      size_t d = i > j ? i - j : j - i;
+      return d <= band ? value / (double)(1 + d) : 0.0;
+    }
+    if (KIND == GEN_TOEPLITZ)
+      return gen_uniform(seed, 0, (uint64_t)i - (uint64_t)j);
+    return value;
+  }
+
+  double operator()(size_t i, size_t j) const
+  {
+    switch (kind)
+    {
+    case GEN_RANDOM:
+      return at<GEN_RANDOM>(i, j);
+    case GEN_BANDED:
+      return at<GEN_BANDED>(i, j);
+    case GEN_TOEPLITZ:
+      return at<GEN_TOEPLITZ>(i, j);
+    default:
+      return at<GEN_CONSTANT>(i, j);
+    }
+  }
+
+  // Columns [col_begin, col_end) of row i hold all its nonzeros
+  size_t col_begin(size_t i) const
+  {
+    return kind == GEN_BANDED && i > band ? i - band : 0;
+  }
+
+  size_t col_end(size_t i, size_t cols) const
+  {
+    if (kind == GEN_BANDED && i + band + 1 < cols)
+      return i + band + 1;
+    return cols;
+  }
+
+  const char *name() const
+  {
+    return generator_names[kind];
+  }
+};
+
+// A[i * ld + j] = gen(i, j) for a rows x cols matrix, in parallel with the
+// static schedule of the kernels so that the pages land near their reader
+template <typename T>
+void generate(T *A, size_t rows, size_t cols, size_t ld, const generator &gen)
+{
+  #pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < rows; i++)
+  {
+    T *row = A + i * ld;
+    switch (gen.kind)
+    {
+    case GEN_RANDOM:
+      for (size_t j = 0; j < cols; j++)
+        row[j] = (T)gen.at<GEN_RANDOM>(i, j);
+      break;
+    case GEN_BANDED:
+      for (size_t j = 0; j < cols; j++)
+        row[j] = (T)gen.at<GEN_BANDED>(i, j);
+      break;
+    case GEN_TOEPLITZ:
+      for (size_t j = 0; j < cols; j++)
+        row[j] = (T)gen.at<GEN_TOEPLITZ>(i, j);
+      break;
+    default:
+      for (size_t j = 0; j < cols; j++)
+        row[j] = (T)gen.value;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,336 @@
+/*
+**  Allocation of the large buffers of part 2 and part 4 with a choice of
+**  page size and NUMA placement, plus a dTLB miss counter to compare them.
+**
+**     default    anonymous mmap, the system decides (THP "always" or not)
+**     thp        2 MB aligned mmap + madvise(MADV_HUGEPAGE)
+**     2m, 1g     explicit MAP_HUGETLB pages, they must be reserved first
+**                (nr_hugepages under /sys/kernel/mm/hugepages),
+**                falls back to thp when the reservation is too small
+**
+**  -interleave spreads the pages over the online NUMA nodes (mbind
+**  MPOL_INTERLEAVE), called before the first touch so it applies.
+**  Nothing here needs libnuma, mbind and perf_event_open are raw syscalls.
+*/
+
+#ifndef TP_OPENMP_HUGE_ALLOC_HPP
+#define TP_OPENMP_HUGE_ALLOC_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <omp.h>
+#include <linux/perf_event.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+enum page_mode
+{
+  PAGES_DEFAULT,
+  PAGES_THP,
+  PAGES_2M,
+  PAGES_1G
+};
+
+static const char *page_mode_names[] = {"default", "thp", "2m", "1g"};
+
+struct huge_config
+{
+  int mode = PAGES_DEFAULT;
+  bool interleave = false;
+};
+
+inline huge_config huge_pages;
+
+// Parses a -pages argument, exits on an unknown name
+inline int parse_page_mode(const char *name)
+{
+  for (int m = PAGES_DEFAULT; m <= PAGES_1G; m++)
+  {
+    if (strcmp(name, page_mode_names[m]) == 0)
+      return m;
+  }
+  printf("  Unknown page mode %s (default, thp, 2m or 1g)\n", name);
+  exit(1);
+}
+
+// Name used in the csv, empty for the default allocation
+inline const char *huge_suffix()
+{
+  static char suffix[32];
+  if (huge_pages.mode == PAGES_DEFAULT && !huge_pages.interleave)
+    return "";
+  snprintf(suffix, sizeof(suffix), " %s%s", page_mode_names[huge_pages.mode], huge_pages.interleave ? " interleave" : "");
+  return suffix;
+}
+
+// Bytes actually mapped for a request, rounded to the page size used
+inline size_t huge_length(size_t bytes, int mode)
+{
+  size_t page = mode == PAGES_1G ? (1ul << 30) : mode == PAGES_DEFAULT ? 4096 : (2ul << 20);
+  return (bytes + page - 1) / page * page;
+}
+
+// Mask of the online nodes from /sys, node 0 alone if it can not be read
+inline unsigned long online_nodes()
+{
+  unsigned long mask = 0;
+  FILE *f = fopen("/sys/devices/system/node/online", "r");
+  int a, b;
+  char sep;
+  while (f != NULL && fscanf(f, "%d", &a) == 1)
+  {
+    b = a;
+    if (fscanf(f, "%c", &sep) == 1 && sep == '-')
+    {
+      if (fscanf(f, "%d", &b) != 1)
+        break;
+      if (fscanf(f, "%c", &sep) != 1)
+        sep = '\n';
+    }
+    for (int n = a; n <= b && n < 64; n++)
+      mask |= 1ul << n;
+    if (sep != ',')
+      break;
+  }
+  if (f != NULL)
+    fclose(f);
+  return mask != 0 ? mask : 1;
+}
+
+// Live mappings and their mapped length: a hugetlb failure changes the mode
+// for the later allocations, not the size of the ones already mapped
+#define HUGE_MAX_MAPPINGS 64
+
+struct huge_mapping
+{
+  void *p;
+  size_t length;
+};
+
+inline huge_mapping huge_mappings[HUGE_MAX_MAPPINGS];
+
+// Allocates bytes with the configured pages, release with huge_free(p, bytes)
+inline void *huge_alloc(size_t bytes)
+{
+  int mode = huge_pages.mode;
+  void *p = MAP_FAILED;
+
+  if (mode == PAGES_2M || mode == PAGES_1G)
+  {
+    int shift = mode == PAGES_1G ? 30 : 21;
+    p = mmap(NULL, huge_length(bytes, mode), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+    if (p == MAP_FAILED)
+    {
+      printf("  MAP_HUGETLB %s failed for %zu bytes (pages reserved?), using thp from now on\n", page_mode_names[mode], bytes);
+      mode = huge_pages.mode = PAGES_THP;
+    }
+  }
+  if (mode == PAGES_THP)
+  {
+    // Over allocate to start on a 2 MB boundary, the ends are given back
+    size_t align = 2ul << 20;
+    size_t length = huge_length(bytes, PAGES_THP);
+    char *raw = (char *)mmap(NULL, length + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw != MAP_FAILED)
+    {
+      char *start = (char *)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+      if (start > raw)
+        munmap(raw, start - raw);
+      munmap(start + length, raw + align - start);
+      madvise(start, length, MADV_HUGEPAGE);
+      p = start;
+    }
+  }
+  if (mode == PAGES_DEFAULT)
+  {
+    p = mmap(NULL, huge_length(bytes, PAGES_DEFAULT), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (p == MAP_FAILED)
+  {
+    printf("  Cannot allocate %zu bytes\n", bytes);
+    exit(1);
+  }
+
+  if (huge_pages.interleave)
+  {
+    unsigned long nodes = online_nodes();
+    if (syscall(SYS_mbind, p, huge_length(bytes, mode), MPOL_INTERLEAVE, &nodes, 64, 0) != 0)
+      perror("  mbind");
+  }
+
+  bool recorded = false;
+  #pragma omp critical(huge_alloc)
+  for (int m = 0; m < HUGE_MAX_MAPPINGS && !recorded; m++)
+  {
+    if (huge_mappings[m].p == NULL)
+    {
+      huge_mappings[m].p = p;
+      huge_mappings[m].length = huge_length(bytes, mode);
+      recorded = true;
+    }
+  }
+  if (!recorded)
+  {
+    printf("  More than %d buffers allocated with huge_alloc\n", HUGE_MAX_MAPPINGS);
+    exit(1);
+  }
+  return p;
+}
+
+// Unmaps the length recorded by huge_alloc, bytes is only checked against it
+inline void huge_free(void *p, size_t bytes)
+{
+  if (p == NULL)
+    return;
+  size_t length = 0;
+  #pragma omp critical(huge_alloc)
+  for (int m = 0; m < HUGE_MAX_MAPPINGS; m++)
+  {
+    if (huge_mappings[m].p == p)
+    {
+      length = huge_mappings[m].length;
+      huge_mappings[m].p = NULL;
+      break;
+    }
+  }
+  if (length < bytes)
+  {
+    printf("  huge_free of a buffer not allocated by huge_alloc\n");
+    exit(1);
+  }
+  if (munmap(p, length) != 0)
+    perror("  munmap");
+}
+
+// Current transparent huge page policy of the system, as printed in /sys
+inline const char *thp_policy()
+{
+  static char policy[64] = "unknown";
+  FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (f != NULL)
+  {
+    if (fgets(policy, sizeof(policy), f) != NULL)
+      policy[strcspn(policy, "\n")] = '\0';
+    fclose(f);
+  }
+  return policy;
+}
+
+// Pages of the buffers, printed by the variants before their timed loop
+inline void print_pages(const char *what)
+{
+  printf("  Pages of %s: %s%s, system THP policy: %s\n", what, page_mode_names[huge_pages.mode],
+         huge_pages.interleave ? " interleaved" : "", thp_policy());
+}
+
+// Misses counted by a tlb_counter, -1 when perf events are not allowed
+inline void print_tlb_misses(long long tlb_misses, int repeat)
+{
+  if (tlb_misses >= 0)
+    printf("  dTLB load misses( %lld ) per repetition( %g )\n", tlb_misses, (double)tlb_misses / repeat);
+  else
+    printf("  dTLB load misses not available (perf_event_paranoid?)\n");
+}
+
+// One line of stats_pages.csv, the same schema for every variant:
+// name,pages,interleave,nb_threads,n,m,repeat (p in part 4),runtime,dtlb
+// with the misses left empty when they were not counted
+inline void write_pages_csv(const std::string &name, int nb_threads, size_t n, size_t m, long k, double runtime,
+                            long long tlb_misses)
+{
+  FILE *f = fopen("stats_pages.csv", "a");
+  if (f == NULL)
+    return;
+  fprintf(f, "%s,%s,%d,%d,%zu,%zu,%ld,%.8g,", name.c_str(), page_mode_names[huge_pages.mode], (int)huge_pages.interleave,
+          nb_threads, n, m, k, runtime);
+  if (tlb_misses >= 0)
+    fprintf(f, "%lld", tlb_misses);
+  fprintf(f, "\n");
+  fclose(f);
+}
+
+// dTLB load misses of the OpenMP threads through perf_event_open, one
+// counter per thread of the team opened by start(), later parallel regions
+// reuse the same threads. Reads -1 where perf events are not allowed.
+#define TLB_MAX_THREADS 1024
+
+struct tlb_counter
+{
+  int fds[TLB_MAX_THREADS];
+  int count = 0;
+
+  void start()
+  {
+    count = omp_get_max_threads();
+    if (count > TLB_MAX_THREADS)
+      count = TLB_MAX_THREADS;
+    for (int t = 0; t < count; t++)
+      fds[t] = -1;
+    #pragma omp parallel
+    {
+      int t = omp_get_thread_num();
+      if (t < count)
+        fds[t] = open_counter();
+    }
+  }
+
+  long long stop()
+  {
+    long long total = 0;
+    for (int t = 0; t < count; t++)
+    {
+      long long value = -1;
+      if (fds[t] >= 0)
+      {
+        ioctl(fds[t], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[t], &value, sizeof(value)) != sizeof(value))
+          value = -1;
+        close(fds[t]);
+        fds[t] = -1;
+      }
+      if (value < 0 || total < 0)
+        total = -1;
+      else
+        total += value;
+    }
+    return total;
+  }
+
+ private:
+
+  // Counter of the calling thread
+  static int open_counter()
+  {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd >= 0)
+    {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    return fd;
+  }
+};
+
+#endif
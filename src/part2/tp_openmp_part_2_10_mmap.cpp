@@ -0,0 +1,559 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+
+using namespace std;
+
+// Binary matrix file: a header padded to one page, then the rows of A as
+// doubles, row-major, so every row offset is known and the data is page aligned.
+#define MATRIX_MAGIC "TPOMPMAT"
+#define MATRIX_HEADER 4096
+
+struct matrix_header
+{
+  char magic[8];
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t elem_size;
+};
+
+// Access modes, selected with -mode
+enum io_mode
+{
+  IO_MMAP,  // whole file mapped, pages faulted in by the compute threads
+  IO_PREAD  // blocks of rows read by thread 0 into two buffers, the others compute
+};
+
+static const char *mode_names[] = {"mmap", "pread"};
+
+size_t parseSize(const char *arg);
+void createMatrixFile(const char *file, size_t N, size_t M);
+int openMatrixFile(const char *file, size_t &N, size_t &M);
+void readFully(int fd, char *buf, size_t bytes, off_t offset);
+double multiplyVectors(const double *a, const double *b, size_t size);
+double timeNow();
+void write_perf_csv(int mode, int nb_threads, size_t n, size_t m, int repeat, double runtime);
+void write_io_csv(int mode, int nb_threads, size_t n, size_t m, int repeat, double runtime,
+                  double io_bandwidth, double io_time, double compute_time, double overlap);
+
+int main(int argc, char *argv[])
+{
+  size_t N = 4096;     // number of rows 2^12
+  size_t M = 1024;     // number of columns 2^10
+  int nrepeat = 10;    // number of repeats of the test
+  int nb_thread = 2;
+  int mode = IO_MMAP;
+  size_t block_bytes = 64 << 20; // bytes of A per pread block
+  bool create = false;
+  bool drop = false;   // evict the file from the page cache before each repetition
+  const char *file = "matrix.bin";
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = parseSize(argv[++i]);
+      printf("  User N is %zu\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = parseSize(argv[++i]);
+      printf("  User M is %zu\n", M);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-F") == 0) || (strcmp(argv[i], "-file") == 0))
+    {
+      file = argv[++i];
+      printf("  User file is %s\n", file);
+    }
+    else if (strcmp(argv[i], "-create") == 0)
+    {
+      create = true;
+    }
+    else if (strcmp(argv[i], "-mode") == 0)
+    {
+      i++;
+      for (mode = 0; mode <= IO_PREAD; mode++)
+      {
+        if (strcmp(argv[i], mode_names[mode]) == 0)
+          break;
+      }
+      if (mode > IO_PREAD)
+      {
+        printf("  Unknown mode %s\n", argv[i]);
+        exit(1);
+      }
+      printf("  User mode is %s\n", mode_names[mode]);
+    }
+    else if ((strcmp(argv[i], "-B") == 0) || (strcmp(argv[i], "-block") == 0))
+    {
+      block_bytes = parseSize(argv[++i]);
+      printf("  User block is %zu bytes\n", block_bytes);
+    }
+    else if (strcmp(argv[i], "-drop") == 0)
+    {
+      drop = true;
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  out of core y^T*A*x Options:\n");
+      printf("  -file (-F) <path>:     binary matrix file (default: matrix.bin)\n");
+      printf("  -create:               write a N x M matrix of ones to the file first\n");
+      printf("  -Rows (-N) <size>:     number of rows of the created matrix (default: 4096)\n");
+      printf("  -Columns (-M) <size>:  number of columns of the created matrix (default: 1024)\n");
+      printf("                         a size is a count (1000), a count with a k, m or g suffix (3k = 3000)\n");
+      printf("                         or a power of two (2^12)\n");
+      printf("  -mode <name>:          mmap or pread (default: mmap)\n");
+      printf("  -block (-B) <size>:    bytes of A read per block in pread mode (default: 64m)\n");
+      printf("  -drop:                 evict the file from the page cache before each repetition\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 10)\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  if (nrepeat < 0 || block_bytes == 0)
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if (create)
+    createMatrixFile(file, N, M);
+  int fd = openMatrixFile(file, N, M);
+  size_t row_bytes = M * sizeof(double);
+  size_t data_bytes = N * row_bytes;
+  printf("  Total size S = %zu N = %zu M = %zu ( %g GB )\n", N * M, N, M, 1.0e-9 * data_bytes);
+
+  // Allocate x,y
+  double *y = new double[N];
+  double *x = new double[M];
+
+  // Initialize y vector to 1.
+  for (size_t i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (size_t j = 0; j < M; j++)
+  {
+    x[j] = 1;
+  }
+
+  char *map = NULL;
+  char *buffers[2] = {NULL, NULL};
+  size_t block_rows = block_bytes / row_bytes;
+  if (block_rows == 0)
+    block_rows = 1;
+  size_t nblocks = (N + block_rows - 1) / block_rows;
+
+  if (mode == IO_MMAP)
+  {
+    map = (char *)mmap(NULL, MATRIX_HEADER + data_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      perror("  mmap");
+      exit(1);
+    }
+    // Readahead as far as the kernel allows, and huge pages where the file
+    // system supports them for page cache (the advice fails elsewhere, ignored)
+    madvise(map, MATRIX_HEADER + data_bytes, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(map, MATRIX_HEADER + data_bytes, MADV_HUGEPAGE);
+#endif
+  }
+  else
+  {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    for (int b = 0; b < 2; b++)
+    {
+      buffers[b] = (char *)aligned_alloc(4096, (block_rows * row_bytes + 4095) / 4096 * 4096);
+      if (buffers[b] == NULL)
+      {
+        printf("  Cannot allocate the %zu bytes blocks\n", block_rows * row_bytes);
+        exit(1);
+      }
+    }
+    printf("  %zu blocks of %zu rows\n", nblocks, block_rows);
+  }
+
+  double io_time = 0;      // thread 0 time spent in pread
+  double compute_time = 0; // sum over the repetitions of the slowest compute thread
+
+  // Timer products.
+  struct timeval begin, end;
+
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    if (drop)
+    {
+      // The pages still mapped by the previous repetition are not evicted
+      // by the fadvise alone, they are unmapped from this process first
+      if (mode == IO_MMAP)
+        madvise(map, MATRIX_HEADER + data_bytes, MADV_DONTNEED);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    double result = 0;
+
+    if (mode == IO_MMAP)
+    {
+      const double *A = (const double *)(map + MATRIX_HEADER);
+
+      #pragma omp parallel for schedule(static) reduction(+ : result)
+      for (size_t i = 0; i < N; i++)
+      {
+        result = result + multiplyVectors(A + i * M, x, M) * y[i];
+      }
+    }
+    else
+    {
+      // Block k + 1 is read while block k is computed, one barrier per block.
+      double first = timeNow();
+      readFully(fd, buffers[0], min(block_rows, N) * row_bytes, MATRIX_HEADER);
+      io_time += timeNow() - first;
+      double slowest = 0;
+
+      #pragma omp parallel reduction(+ : result)
+      {
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        // Thread 0 only reads, unless it is alone
+        int workers = nt > 1 ? nt - 1 : 1;
+        int w = nt > 1 ? tid - 1 : 0;
+        double busy = 0;
+
+        for (size_t k = 0; k < nblocks; k++)
+        {
+          if (tid == 0 && k + 1 < nblocks)
+          {
+            size_t r0 = (k + 1) * block_rows;
+            size_t rows = min(block_rows, N - r0);
+            double t0 = timeNow();
+            readFully(fd, buffers[(k + 1) & 1], rows * row_bytes, MATRIX_HEADER + r0 * row_bytes);
+            io_time += timeNow() - t0;
+          }
+          if (w >= 0)
+          {
+            double t0 = timeNow();
+            const double *A = (const double *)buffers[k & 1];
+            size_t r0 = k * block_rows;
+            size_t rows = min(block_rows, N - r0);
+            for (size_t i = rows * w / workers; i < rows * (w + 1) / workers; i++)
+            {
+              result = result + multiplyVectors(A + i * M, x, M) * y[r0 + i];
+            }
+            busy += timeNow() - t0;
+          }
+          #pragma omp barrier
+        }
+
+        #pragma omp critical
+        slowest = max(slowest, busy);
+      }
+      compute_time += slowest;
+    }
+
+    // Output result.
+    if (repeat == (nrepeat - 1))
+    {
+      printf("  Computed result for %zu x %zu is %lf\n", N, M, result);
+    }
+
+    const double solution = (double)N * (double)M;
+
+    if (result != solution)
+    {
+      printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+    }
+  }
+
+  gettimeofday(&end, NULL);
+
+  // Calculate time.
+  double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once from the file.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (M + M * N + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %zu ) M( %zu ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+
+  // With mmap the reads happen inside the page faults of the kernel loop, only
+  // the file bandwidth seen by the whole loop is known.
+  double io_bandwidth = 1.0e-9 * data_bytes * nrepeat / (mode == IO_PREAD ? io_time : time);
+  double overlap = -1;
+  if (mode == IO_PREAD)
+  {
+    // Part of the shorter of read and compute hidden behind the other one,
+    // 1 when the run takes max(io, compute), 0 when it takes io + compute.
+    // The first block of each repetition can not be overlapped.
+    double hidden = io_time + compute_time - time;
+    overlap = max(0.0, min(1.0, hidden / min(io_time, compute_time)));
+    printf("  io time( %g s ) io bandwidth( %g GB/s ) compute time( %g s ) overlap( %g %% )\n",
+           io_time, io_bandwidth, compute_time, 100 * overlap);
+  }
+  else
+  {
+    printf("  file bandwidth( %g GB/s )%s\n", io_bandwidth, drop ? "" : ", the file may be cached (see -drop)");
+  }
+
+  write_perf_csv(mode, nb_thread, N, M, nrepeat, time);
+  write_io_csv(mode, nb_thread, N, M, nrepeat, time, io_bandwidth, io_time, compute_time, overlap);
+
+  if (map != NULL)
+    munmap(map, MATRIX_HEADER + data_bytes);
+  free(buffers[0]);
+  free(buffers[1]);
+  close(fd);
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+// Reads a dimension: 1000, 3k, 2m, 1g (powers of ten) or 2^20
+size_t parseSize(const char *arg)
+{
+  char *end;
+  if (strncmp(arg, "2^", 2) == 0)
+  {
+    unsigned long e = strtoul(arg + 2, &end, 10);
+    if (*end != '\0' || e > 62)
+    {
+      printf("  Invalid size %s\n", arg);
+      exit(1);
+    }
+    return (size_t)1 << e;
+  }
+  errno = 0;
+  size_t v = strtoull(arg, &end, 10);
+  size_t scale = 1;
+  if (*end == 'k' || *end == 'K')
+    scale = 1000, end++;
+  else if (*end == 'm' || *end == 'M')
+    scale = 1000000, end++;
+  else if (*end == 'g' || *end == 'G')
+    scale = 1000000000, end++;
+  if (*end != '\0' || end == arg)
+  {
+    printf("  Invalid size %s\n", arg);
+    exit(1);
+  }
+  if (errno == ERANGE || v > SIZE_MAX / scale)
+  {
+    printf("  Size %s overflows\n", arg);
+    exit(1);
+  }
+  return v * scale;
+}
+
+// Writes a N x M matrix of ones, a few rows at a time so it can exceed the memory
+void createMatrixFile(const char *file, size_t N, size_t M)
+{
+  FILE *f = fopen(file, "wb");
+  if (f == NULL)
+  {
+    perror("  fopen");
+    exit(1);
+  }
+  char header[MATRIX_HEADER] = {0};
+  matrix_header h;
+  memcpy(h.magic, MATRIX_MAGIC, 8);
+  h.rows = N;
+  h.cols = M;
+  h.elem_size = sizeof(double);
+  memcpy(header, &h, sizeof(h));
+  fwrite(header, 1, MATRIX_HEADER, f);
+
+  size_t rows = max((size_t)1, ((size_t)16 << 20) / (M * sizeof(double)));
+  double *chunk = new double[rows * M];
+  for (size_t k = 0; k < rows * M; k++)
+  {
+    chunk[k] = 1;
+  }
+  for (size_t i = 0; i < N; i += rows)
+  {
+    size_t n = min(rows, N - i);
+    if (fwrite(chunk, sizeof(double) * M, n, f) != n)
+    {
+      perror("  fwrite");
+      exit(1);
+    }
+  }
+  delete[] chunk;
+  fclose(f);
+  printf("  Created %s, %zu x %zu\n", file, N, M);
+}
+
+int openMatrixFile(const char *file, size_t &N, size_t &M)
+{
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("  open");
+    exit(1);
+  }
+  matrix_header h;
+  struct stat st;
+  if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h.magic, MATRIX_MAGIC, 8) != 0 ||
+      h.elem_size != sizeof(double))
+  {
+    printf("  %s is not a matrix file of doubles\n", file);
+    exit(1);
+  }
+  fstat(fd, &st);
+  // A malformed header must not wrap the size below the file size
+  if (h.rows == 0 || h.cols == 0 || h.rows > (SIZE_MAX - MATRIX_HEADER) / sizeof(double) / h.cols)
+  {
+    printf("  %s has an invalid size %llu x %llu\n", file, (unsigned long long)h.rows, (unsigned long long)h.cols);
+    exit(1);
+  }
+  if ((uint64_t)st.st_size < MATRIX_HEADER + h.rows * h.cols * sizeof(double))
+  {
+    printf("  %s is truncated\n", file);
+    exit(1);
+  }
+  N = h.rows;
+  M = h.cols;
+  return fd;
+}
+
+void readFully(int fd, char *buf, size_t bytes, off_t offset)
+{
+  while (bytes > 0)
+  {
+    ssize_t r = pread(fd, buf, bytes, offset);
+    if (r <= 0)
+    {
+      perror("  pread");
+      exit(1);
+    }
+    buf += r;
+    bytes -= r;
+    offset += r;
+  }
+}
+
+double multiplyVectors(const double *a, const double *b, size_t size)
+{
+  double sum = 0;
+  #pragma omp simd reduction(+ : sum)
+  for (size_t i = 0; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+double timeNow()
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1.0e-6 * t.tv_usec;
+}
+
+void write_perf_csv(int mode, int nb_threads, size_t n, size_t m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << "2_10 out of core " << mode_names[mode]
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
+
+// io_time, compute_time and overlap are left empty in mmap mode
+void write_io_csv(int mode, int nb_threads, size_t n, size_t m, int repeat, double runtime,
+                  double io_bandwidth, double io_time, double compute_time, double overlap)
+{
+  ofstream myfile;
+  myfile.open("stats_part2_io.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << "2_10 out of core " << mode_names[mode]
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "," << io_bandwidth << ",";
+  if (overlap >= 0)
+    myfile << io_time << "," << compute_time << "," << overlap;
+  else
+    myfile << ",,";
+  myfile << "\n";
+
+  myfile.close();
+}
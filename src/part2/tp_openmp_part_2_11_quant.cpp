@@ -0,0 +1,555 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include "../huge_alloc.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Elements sharing a scale in block mode, and unit of the integer kernels
+// (one 256-bit vector of int8). Rows are padded with zeros to a multiple.
+#define QBLOCK 32
+
+// Storage of A, selected with -P
+enum precision
+{
+  PREC_FP64,
+  PREC_INT8,
+  PREC_INT4
+};
+
+static const char *precision_names[] = {"fp64", "int8", "int4"};
+
+// Quantized matrix: symmetric, q = round(a / scale), with one scale per row
+// or per QBLOCK elements. int4 values are stored biased (q + 8, 1..15), the
+// low nibbles of the 16 bytes of a block hold its 16 first values and the
+// high nibbles the 16 last ones, so both halves unpack with one shift.
+struct quant_matrix
+{
+  int N, Mp;         // rows, padded columns
+  int bits;          // 8 or 4
+  bool per_block;
+  int8_t *q;         // N * Mp values (int8) or N * Mp / 2 bytes (int4)
+  float *scale;      // N or N * Mp / QBLOCK scales
+};
+
+// x quantized to int8 with the same granularity as A, plus the block sums
+// used to remove the int4 bias
+struct quant_vector
+{
+  int8_t *q;
+  float *scale;      // one scale, or one per block
+  int32_t *block_sum;
+};
+
+double multiplyVectors(double *a, double *b, int sizea, int sizeb);
+void quantizeMatrix(double **A, int N, int M, int bits, bool per_block, quant_matrix &Q);
+void quantizeVector(const double *x, int M, int Mp, bool per_block, quant_vector &X);
+double multiplyQuantRow(const quant_matrix &Q, const quant_vector &X, int i);
+const char *quantKernelName();
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+
+// Deterministic values in [-1, 1], so quantization actually loses something
+double valueAt(uint32_t i, uint32_t j)
+{
+  uint32_t h = i * 2654435761u ^ (j + 0x9e3779b9u) * 40503u;
+  h ^= h >> 15;
+  h *= 2246822519u;
+  h ^= h >> 13;
+  return (h % 2001) / 1000.0 - 1.0;
+}
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  int prec = PREC_INT8;
+  bool per_block = true;
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-P") == 0) || (strcmp(argv[i], "-precision") == 0))
+    {
+      i++;
+      for (prec = 0; prec <= PREC_INT4; prec++)
+      {
+        if (strcmp(argv[i], precision_names[prec]) == 0)
+          break;
+      }
+      if (prec > PREC_INT4)
+      {
+        printf("  Unknown precision %s\n", argv[i]);
+        exit(1);
+      }
+      printf("  User precision is %s\n", precision_names[prec]);
+    }
+    else if (strcmp(argv[i], "-scale") == 0)
+    {
+      i++;
+      if (strcmp(argv[i], "row") == 0)
+        per_block = false;
+      else if (strcmp(argv[i], "block") == 0)
+        per_block = true;
+      else
+      {
+        printf("  Unknown scale granularity %s\n", argv[i]);
+        exit(1);
+      }
+      printf("  User scale granularity is %s\n", argv[i]);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A and its quantized copy are interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  quantized y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -precision (-P) <name>: storage of A timed, fp64, int8 or int4 (default: int8)\n");
+      printf("  -scale <name>:         one scale per row or per block of %d elements (default: block)\n", QBLOCK);
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -pages <name>:         pages of A and its quantized copy, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A and its quantized copy over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  if (N < 1 || M < 1 || nrepeat < 0)
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  // Allocate x,y,A
+  double *y = new double[N];
+  double *x = new double[M];
+  double **A = new double *[N];
+  // A is one block so its pages can be chosen, the rows point into it.
+  double *A_data = (double *)huge_alloc((size_t)N * M * sizeof(double));
+
+  for (int i = 0; i < N; i++)
+  {
+    A[i] = A_data + (size_t)i * M;
+  }
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector with values in [-1, 1].
+  for (int j = 0; j < M; j++)
+  {
+    x[j] = valueAt(0xffffffffu, j);
+  }
+
+  // Initialize A matrix with values in [-1, 1].
+  #pragma omp parallel for
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      A[i][j] = valueAt(i, j);
+    }
+  }
+
+  int Mp = (M + QBLOCK - 1) / QBLOCK * QBLOCK;
+  quant_matrix Q;
+  quant_vector X;
+  quantizeMatrix(A, N, M, prec == PREC_INT4 ? 4 : 8, per_block, Q);
+  quantizeVector(x, M, Mp, per_block, X);
+
+  // Error of the quantized path against FP64, per row dot product and in total.
+  double solution = 0, quantized = 0, max_row_error = 0, max_row = 0;
+  for (int i = 0; i < N; i++)
+  {
+    double exact = multiplyVectors(A[i], x, M, M);
+    double approx = multiplyQuantRow(Q, X, i);
+    solution += exact * y[i];
+    quantized += approx * y[i];
+    max_row_error = max(max_row_error, fabs(approx - exact));
+    max_row = max(max_row, fabs(exact));
+  }
+  printf("  %s kernel: %s, scales per %s\n", Q.bits == 4 ? "int4" : "int8", quantKernelName(), per_block ? "block" : "row");
+  printf("  FP64 result( %lf ) quantized result( %lf ) relative error( %g )\n",
+         solution, quantized, fabs(quantized - solution) / fabs(solution));
+  printf("  max row error( %g ) relative to the largest row( %g )\n", max_row_error, max_row_error / max_row);
+
+  print_pages("A and its quantized copy");
+
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    double result = 0;
+
+    if (prec == PREC_FP64)
+    {
+      #pragma omp parallel for reduction(+ : result)
+      for (int i = 0; i < N; i++)
+      {
+        result = result + multiplyVectors(A[i], x, M, M) * y[i];
+      }
+    }
+    else
+    {
+      #pragma omp parallel for reduction(+ : result)
+      for (int i = 0; i < N; i++)
+      {
+        result = result + multiplyQuantRow(Q, X, i) * y[i];
+      }
+    }
+    // Output result.
+    if (repeat == (nrepeat - 1))
+    {
+      printf("  Computed result for %d x %d is %lf\n", N, M, result);
+    }
+
+    // Summation order may differ from the check above
+    const double expected = prec == PREC_FP64 ? solution : quantized;
+
+    if (fabs(result - expected) > 1e-6 * fabs(expected) + 1e-6)
+    {
+      printf("  Error: result( %lf ) != solution( %lf )\n", result, expected);
+    }
+  }
+
+  gettimeofday(&end, NULL);
+  long long tlb_misses = tlb.stop();
+
+  // Calculate time.
+  double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+  // Calculate bandwidth.
+  // Each matrix A row is read once, as doubles or as quantized values and scales.
+  // The x vector is read N times, the y vector once.
+  double a_bytes = sizeof(double) * (double)M * N;
+  if (prec != PREC_FP64)
+  {
+    int nscales = per_block ? Mp / QBLOCK : 1;
+    a_bytes = ((double)Mp * Q.bits / 8 + sizeof(float) * nscales) * N;
+  }
+  double Gbytes = 1.0e-9 * (a_bytes + sizeof(double) * (M + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  printf("  A traffic reduced %gx from FP64\n", sizeof(double) * (double)M * N / a_bytes);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  string name = string("2_11 ") + precision_names[prec];
+  if (prec != PREC_FP64)
+    name += per_block ? " block" : " row";
+  write_perf_csv(name, nb_thread, N, M, nrepeat, time);
+  write_pages_csv(name, nb_thread, N, M, nrepeat, time, tlb_misses);
+  huge_free(A_data, (size_t)N * M * sizeof(double));
+  delete[] A;
+  delete[] y;
+  delete[] x;
+  huge_free(Q.q, (size_t)N * Mp * Q.bits / 8);
+  free(Q.scale);
+  free(X.q);
+  free(X.scale);
+  free(X.block_sum);
+
+  return 0;
+}
+
+double multiplyVectors(double *a, double *b, int sizea, int sizeb)
+{
+
+  assert(sizea == sizeb);
+  double sum = 0;
+  #pragma omp simd reduction(+ : sum)
+  for (int i = 0; i < sizea; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+// Largest magnitude of a[0..n) mapped to qmax, zero blocks keep scale 1
+static float chooseScale(const double *a, int n, int qmax)
+{
+  double amax = 0;
+  for (int j = 0; j < n; j++)
+  {
+    amax = max(amax, fabs(a[j]));
+  }
+  return amax > 0 ? amax / qmax : 1;
+}
+
+void quantizeMatrix(double **A, int N, int M, int bits, bool per_block, quant_matrix &Q)
+{
+  int Mp = (M + QBLOCK - 1) / QBLOCK * QBLOCK;
+  int nblocks = Mp / QBLOCK;
+  int qmax = bits == 4 ? 7 : 127;
+  Q.N = N;
+  Q.Mp = Mp;
+  Q.bits = bits;
+  Q.per_block = per_block;
+  Q.q = (int8_t *)huge_alloc((size_t)N * Mp * bits / 8);
+  Q.scale = (float *)aligned_alloc(64, ((size_t)N * (per_block ? nblocks : 1) * sizeof(float) + 63) / 64 * 64);
+
+  #pragma omp parallel for
+  for (int i = 0; i < N; i++)
+  {
+    float row_scale = chooseScale(A[i], M, qmax);
+    if (!per_block)
+      Q.scale[i] = row_scale;
+    for (int b = 0; b < nblocks; b++)
+    {
+      int j0 = b * QBLOCK;
+      int n = min(QBLOCK, M - j0);
+      float s = row_scale;
+      if (per_block)
+      {
+        s = chooseScale(A[i] + j0, n, qmax);
+        Q.scale[(size_t)i * nblocks + b] = s;
+      }
+      int8_t v[QBLOCK] = {0};
+      for (int k = 0; k < n; k++)
+      {
+        v[k] = (int8_t)lrint(A[i][j0 + k] / s);
+      }
+      if (bits == 8)
+      {
+        memcpy(Q.q + (size_t)i * Mp + j0, v, QBLOCK);
+      }
+      else
+      {
+        uint8_t *p = (uint8_t *)Q.q + ((size_t)i * Mp + j0) / 2;
+        for (int k = 0; k < QBLOCK / 2; k++)
+        {
+          p[k] = (uint8_t)((v[k] + 8) | ((v[k + QBLOCK / 2] + 8) << 4));
+        }
+      }
+    }
+  }
+}
+
+void quantizeVector(const double *x, int M, int Mp, bool per_block, quant_vector &X)
+{
+  int nblocks = Mp / QBLOCK;
+  X.q = (int8_t *)aligned_alloc(64, (Mp + 63) / 64 * 64);
+  X.scale = (float *)malloc(sizeof(float) * nblocks);
+  X.block_sum = (int32_t *)malloc(sizeof(int32_t) * nblocks);
+  float vector_scale = chooseScale(x, M, 127);
+  for (int b = 0; b < nblocks; b++)
+  {
+    int j0 = b * QBLOCK;
+    int n = min(QBLOCK, M - j0);
+    float s = per_block ? chooseScale(x + j0, n, 127) : vector_scale;
+    X.scale[b] = s;
+    X.block_sum[b] = 0;
+    for (int k = 0; k < QBLOCK; k++)
+    {
+      X.q[j0 + k] = k < n ? (int8_t)lrint(x[j0 + k] / s) : 0;
+      X.block_sum[b] += X.q[j0 + k];
+    }
+  }
+}
+
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+// u8 * s8 products summed by 4 into the int32 lanes, one instruction
+static inline __m256i dotBytes(__m256i acc, __m256i u, __m256i s)
+{
+  return _mm256_dpbusd_epi32(acc, u, s);
+}
+#elif defined(__AVX2__)
+// u8 * s8 products summed by 2 in int16 (no saturation, |products| <= 2 * 127 * 127
+// for int8 and 2 * 15 * 127 for int4), then by 2 more in int32
+static inline __m256i dotBytes(__m256i acc, __m256i u, __m256i s)
+{
+  __m256i p16 = _mm256_maddubs_epi16(u, s);
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(p16, _mm256_set1_epi16(1)));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline int32_t sumLanes(__m256i v)
+{
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+
+// Integer dot product of one block. maddubs/dpbusd multiply unsigned by
+// signed bytes: int8 A goes through |a| and sign(x, a), int4 A is already
+// unsigned (biased) and the bias is removed with the block sum of x.
+static inline int32_t dotBlock(const quant_matrix &Q, const quant_vector &X, const int8_t *qa, int j0, int b)
+{
+  __m256i xv = _mm256_load_si256((const __m256i *)(X.q + j0));
+  if (Q.bits == 8)
+  {
+    __m256i av = _mm256_loadu_si256((const __m256i *)qa);
+    return sumLanes(dotBytes(_mm256_setzero_si256(), _mm256_sign_epi8(av, av), _mm256_sign_epi8(xv, av)));
+  }
+  __m128i packed = _mm_loadu_si128((const __m128i *)qa);
+  __m128i mask = _mm_set1_epi8(0x0f);
+  __m256i av = _mm256_set_m128i(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), _mm_and_si128(packed, mask));
+  return sumLanes(dotBytes(_mm256_setzero_si256(), av, xv)) - 8 * X.block_sum[b];
+}
+#else
+static inline int32_t dotBlock(const quant_matrix &Q, const quant_vector &X, const int8_t *qa, int j0, int b)
+{
+  int32_t sum = 0;
+  if (Q.bits == 8)
+  {
+    for (int k = 0; k < QBLOCK; k++)
+    {
+      sum += qa[k] * X.q[j0 + k];
+    }
+    return sum;
+  }
+  const uint8_t *p = (const uint8_t *)qa;
+  for (int k = 0; k < QBLOCK / 2; k++)
+  {
+    sum += ((p[k] & 0x0f) - 8) * X.q[j0 + k] + ((p[k] >> 4) - 8) * X.q[j0 + k + QBLOCK / 2];
+  }
+  return sum;
+}
+#endif
+
+const char *quantKernelName()
+{
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  return "AVX512-VNNI dpbusd";
+#elif defined(__AVX2__)
+  return "AVX2 maddubs";
+#else
+  return "scalar";
+#endif
+}
+
+// Row i of A times x, scaled back to the real values. With one scale per
+// row the integer sums of the blocks add up exactly before a single product.
+double multiplyQuantRow(const quant_matrix &Q, const quant_vector &X, int i)
+{
+  int nblocks = Q.Mp / QBLOCK;
+  const int8_t *qa = Q.q + (size_t)i * Q.Mp * Q.bits / 8;
+  int step = QBLOCK * Q.bits / 8;
+
+  if (!Q.per_block)
+  {
+    int64_t sum = 0;
+    for (int b = 0; b < nblocks; b++)
+    {
+      sum += dotBlock(Q, X, qa + b * step, b * QBLOCK, b);
+    }
+    return (double)sum * Q.scale[i] * X.scale[0];
+  }
+
+  const float *sa = Q.scale + (size_t)i * nblocks;
+  double sum = 0;
+  for (int b = 0; b < nblocks; b++)
+  {
+    sum += (double)dotBlock(Q, X, qa + b * step, b * QBLOCK, b) * (sa[b] * X.scale[b]);
+  }
+  return sum;
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
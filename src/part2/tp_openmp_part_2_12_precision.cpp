@@ -0,0 +1,304 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include "../bf16.hpp"
+#include "../huge_alloc.hpp"
+
+using namespace std;
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+void write_precision_csv(const string &name, const char *storage, const char *accumulate, int nb_threads,
+                         int rows, int cols, int inner, int repeat, double runtime, double gflops, double error);
+
+// Deterministic values in [-1, 1], so the precision of the storage shows
+double valueAt(uint32_t i, uint32_t j)
+{
+  uint32_t h = i * 2654435761u ^ (j + 0x9e3779b9u) * 40503u;
+  h ^= h >> 15;
+  h *= 2246822519u;
+  h ^= h >> 13;
+  return (h % 2001) / 1000.0 - 1.0;
+}
+
+// y^T*A*x with A and x stored as T, the row dot products accumulated in Acc
+// and their sum in double. Returns the runtime, result is the last value.
+// A uses the pages chosen with -pages, its dTLB misses go to tlb_misses.
+template <typename T, typename Acc>
+double run(int N, int M, int nrepeat, double &result, long long &tlb_misses)
+{
+  // Allocate x,y,A
+  double *y = new double[N];
+  T *x = new T[M];
+  T **A = new T *[N];
+  // A is one block so its pages can be chosen, the rows point into it.
+  T *A_data = (T *)huge_alloc((size_t)N * M * sizeof(T));
+
+  for (int i = 0; i < N; i++)
+  {
+    A[i] = A_data + (size_t)i * M;
+  }
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector with values in [-1, 1].
+  for (int j = 0; j < M; j++)
+  {
+    x[j] = T(valueAt(0xffffffffu, j));
+  }
+
+  // Initialize A matrix with values in [-1, 1].
+  #pragma omp parallel for
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      A[i][j] = T(valueAt(i, j));
+    }
+  }
+
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    double sum = 0;
+
+    #pragma omp parallel for reduction(+ : sum)
+    for (int i = 0; i < N; i++)
+    {
+      sum = sum + (double)dot<T, Acc>(A[i], x, M) * y[i];
+    }
+    result = sum;
+  }
+
+  gettimeofday(&end, NULL);
+  tlb_misses = tlb.stop();
+
+  huge_free(A_data, (size_t)N * M * sizeof(T));
+  delete[] A;
+  delete[] x;
+  delete[] y;
+
+  // Calculate time.
+  return 1.0 * (end.tv_sec - begin.tv_sec) +
+         1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  string storage = "fp64";
+  string accumulate = "fp64";
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-P") == 0) || (strcmp(argv[i], "-precision") == 0))
+    {
+      storage = argv[++i];
+      printf("  User storage is %s\n", storage.c_str());
+    }
+    else if ((strcmp(argv[i], "-A") == 0) || (strcmp(argv[i], "-accumulate") == 0))
+    {
+      accumulate = argv[++i];
+      printf("  User accumulation is %s\n", accumulate.c_str());
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  mixed precision y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -precision (-P) <name>: storage of A and x, fp64, fp32 or bf16 (default: fp64)\n");
+      printf("  -accumulate (-A) <name>: accumulation of the dot products, fp64 or fp32 (default: fp64)\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  if (N < 1 || M < 1 || nrepeat < 1)
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  // FP64 reference computed from the exact values.
+  double solution = 0;
+  #pragma omp parallel for reduction(+ : solution)
+  for (int i = 0; i < N; i++)
+  {
+    double sum = 0;
+    for (int j = 0; j < M; j++)
+    {
+      sum += valueAt(i, j) * valueAt(0xffffffffu, j);
+    }
+    solution += sum;
+  }
+
+  double result = 0, time = 0;
+  long long tlb_misses = -1;
+  size_t elem_size = 0;
+  print_pages("A");
+  if (storage == "fp64" && accumulate == "fp64")
+    time = run<double, double>(N, M, nrepeat, result, tlb_misses), elem_size = sizeof(double);
+  else if (storage == "fp32" && accumulate == "fp64")
+    time = run<float, double>(N, M, nrepeat, result, tlb_misses), elem_size = sizeof(float);
+  else if (storage == "fp32" && accumulate == "fp32")
+    time = run<float, float>(N, M, nrepeat, result, tlb_misses), elem_size = sizeof(float);
+  else if (storage == "bf16" && accumulate == "fp64")
+    time = run<bf16, double>(N, M, nrepeat, result, tlb_misses), elem_size = sizeof(bf16);
+  else if (storage == "bf16" && accumulate == "fp32")
+    time = run<bf16, float>(N, M, nrepeat, result, tlb_misses), elem_size = sizeof(bf16);
+  else
+  {
+    printf("  Unsupported storage %s with accumulation %s\n", storage.c_str(), accumulate.c_str());
+    exit(1);
+  }
+
+  // Output result.
+  double error = fabs(result - solution) / fabs(solution);
+  printf("  Computed result for %d x %d is %lf, FP64 reference %lf, relative error( %g )\n",
+         N, M, result, solution, error);
+  if (storage == "bf16" && accumulate == "fp32")
+    printf("  bf16 kernel: %s\n", bf16_kernel_name());
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  double Gbytes = 1.0e-9 * double(elem_size * (M + (double)M * N) + sizeof(double) * N);
+  double gflops = 2.0e-9 * (double)N * M * nrepeat / time;
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s ) GFLOPS( %g )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time, gflops);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  string base = "2_12 " + storage + " acc " + accumulate;
+  string name = base + huge_suffix();
+  write_perf_csv(name, nb_thread, N, M, nrepeat, time);
+  write_pages_csv(base, nb_thread, N, M, nrepeat, time, tlb_misses);
+  write_precision_csv(name, storage.c_str(), accumulate.c_str(), nb_thread, N, 1, M, nrepeat, time, gflops, error);
+
+  return 0;
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
+
+// Shared with part 4: a GEMV is rows x 1 with inner dimension M
+void write_precision_csv(const string &name, const char *storage, const char *accumulate, int nb_threads,
+                         int rows, int cols, int inner, int repeat, double runtime, double gflops, double error)
+{
+  ofstream myfile;
+  myfile.open("stats_precision.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << "," << storage << "," << accumulate
+         << "," << nb_threads << "," << rows << "," << cols << "," << inner << "," << repeat
+         << "," << runtime << "," << gflops << "," << error << "\n";
+
+  myfile.close();
+}
@@ -0,0 +1,551 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <unistd.h>
+#include "../huge_alloc.hpp"
+#ifdef __AVX512F__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Kernels of the dot product of a row with x
+enum kernel_kind
+{
+  KERNEL_PLAIN,    // simd loop, hardware prefetcher only
+  KERNEL_PREFETCH, // software prefetch of A at a fixed distance ahead
+  KERNEL_NT        // non-temporal loads of A (movntdqa), prefetched with the NTA hint
+};
+
+static const char *kernel_names[] = {"plain", "prefetch", "nt"};
+
+// Distances tried by -sweep, in bytes ahead of the load
+static const int sweep_distances[] = {64, 128, 256, 512, 1024, 2048, 4096, 8192};
+
+#define TUNING_FILE "prefetch_distance.txt"
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat);
+double runKernel(int kernel, bool nta, int distance, double **A, double *x, double *y, int N, int M, int nrepeat,
+                 double &result, long long &tlb_misses);
+string tuningKey(int kernel, bool nta);
+int readTunedDistance(const char *host, const string &key);
+void writeTunedDistance(const char *host, const string &key, int distance);
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+void write_prefetch_csv(const char *host, const string &name, int nb_threads, int n, int m, int repeat, int distance,
+                        double runtime, double bandwidth);
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int S = 4096 * 1024; // total size 2^22
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  int kernel = KERNEL_PREFETCH;
+  int distance = -1;   // bytes, -1 reads the tuned value (or 512)
+  bool nta = false;    // prefetch hint of the prefetch kernel, T0 by default
+  bool sweep = false;
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if ((strcmp(argv[i], "-S") == 0) || (strcmp(argv[i], "-Size") == 0))
+    {
+      S = pow(2, atof(argv[++i]));
+      printf("  User S is %d\n", S);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-K") == 0) || (strcmp(argv[i], "-kernel") == 0))
+    {
+      kernel = -1;
+      for (int k = KERNEL_PLAIN; k <= KERNEL_NT; k++)
+      {
+        if (strcmp(argv[i + 1], kernel_names[k]) == 0)
+          kernel = k;
+      }
+      if (kernel < 0)
+      {
+        printf("  Unknown kernel %s (plain, prefetch or nt)\n", argv[i + 1]);
+        exit(1);
+      }
+      i++;
+      printf("  User kernel is %s\n", kernel_names[kernel]);
+    }
+    else if ((strcmp(argv[i], "-D") == 0) || (strcmp(argv[i], "-distance") == 0))
+    {
+      distance = atoi(argv[++i]);
+      printf("  User prefetch distance is %d bytes\n", distance);
+    }
+    else if (strcmp(argv[i], "-nta") == 0)
+    {
+      nta = true;
+      printf("  Prefetch with the NTA hint\n");
+    }
+    else if (strcmp(argv[i], "-sweep") == 0)
+    {
+      sweep = true;
+      printf("  Sweep of the prefetch distance\n");
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -Size (-S) <int>:      exponent num, determines total matrix size 2^num (default: 2^22 = 4096*1024 )\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -kernel (-K) <name>:   plain, prefetch or nt (default: prefetch)\n");
+      printf("  -distance (-D) <int>:  prefetch distance in bytes (default: tuned value of %s, else 512)\n", TUNING_FILE);
+      printf("  -nta:                  prefetch kernel uses the NTA hint instead of T0\n");
+      printf("  -sweep:                time every distance, keep the best one in %s\n", TUNING_FILE);
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  S = N * M;
+  // Check sizes.
+  checkSizes(N, M, S, nrepeat);
+
+  if (kernel == KERNEL_PLAIN && sweep)
+  {
+    printf("  The plain kernel has no prefetch distance to sweep.\n");
+    exit(1);
+  }
+#ifndef __AVX512F__
+  if (kernel == KERNEL_NT)
+    printf("  No AVX-512 non-temporal load, the nt kernel only prefetches with NTA.\n");
+#endif
+
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+
+  // Allocate x,y,A. A is one page aligned block so that the prefetches
+  // run across the rows, the non-temporal loads are aligned and its pages
+  // can be chosen.
+  double *y = new double[N];
+  double *x = new double[M];
+  double **A = new double *[N];
+  double *A_data = (double *)huge_alloc((size_t)S * sizeof(double));
+
+  for (int i = 0; i < N; i++)
+  {
+    A[i] = A_data + (size_t)i * M;
+  }
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (int i = 0; i < M; i++)
+  {
+    x[i] = 1;
+  }
+
+  // Initialize A matrix, with the schedule of the kernel for the first touch
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      A[i][j] = 1;
+    }
+  }
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (M + (double)M * N + N));
+  double result = 0, time = 0;
+  long long tlb_misses = -1;
+  print_pages("A");
+
+  if (sweep)
+  {
+    // Without any software prefetch first, the baseline to beat
+    time = runKernel(KERNEL_PLAIN, false, 0, A, x, y, N, M, nrepeat, result, tlb_misses);
+    printf("  %-8s distance( none ) time( %g s ) bandwidth( %g GB/s )\n", kernel_names[KERNEL_PLAIN], time,
+           Gbytes * nrepeat / time);
+    write_prefetch_csv(host, "2_13 plain", nb_thread, N, M, nrepeat, 0, time, Gbytes * nrepeat / time);
+
+    double best_time = 0;
+    long long best_misses = -1;
+    int best = 0;
+    string name = string("2_13 ") + kernel_names[kernel] + (nta && kernel == KERNEL_PREFETCH ? " nta" : "");
+    for (int d : sweep_distances)
+    {
+      time = runKernel(kernel, nta, d, A, x, y, N, M, nrepeat, result, tlb_misses);
+      printf("  %-8s distance( %d ) time( %g s ) bandwidth( %g GB/s )\n", kernel_names[kernel], d, time,
+             Gbytes * nrepeat / time);
+      write_prefetch_csv(host, name, nb_thread, N, M, nrepeat, d, time, Gbytes * nrepeat / time);
+      if (best == 0 || time < best_time)
+      {
+        best = d;
+        best_time = time;
+        best_misses = tlb_misses;
+      }
+    }
+    printf("  Best %s distance on %s is %d bytes, %g GB/s, saved in %s\n", kernel_names[kernel], host, best,
+           Gbytes * nrepeat / best_time, TUNING_FILE);
+    writeTunedDistance(host, tuningKey(kernel, nta), best);
+    distance = best;
+    time = best_time;
+    tlb_misses = best_misses;
+  }
+  else
+  {
+    if (distance < 0)
+    {
+      distance = readTunedDistance(host, tuningKey(kernel, nta));
+      if (kernel != KERNEL_PLAIN)
+        printf("  Prefetch distance %d bytes (%s)\n", distance < 0 ? 512 : distance,
+               distance < 0 ? "default" : "tuned");
+      if (distance < 0)
+        distance = 512;
+    }
+    time = runKernel(kernel, nta, distance, A, x, y, N, M, nrepeat, result, tlb_misses);
+  }
+
+  // Output result.
+  printf("  Computed result for %d x %d is %lf\n", N, M, result);
+  const double solution = (double)N * (double)M;
+  if (result != solution)
+  {
+    printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+  }
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  string name = string("2_13 ") + kernel_names[kernel];
+  if (kernel != KERNEL_PLAIN)
+    name += (nta && kernel == KERNEL_PREFETCH ? " nta " : " ") + to_string(distance);
+  write_perf_csv(name, nb_thread, N, M, nrepeat, time);
+  write_pages_csv(name, nb_thread, N, M, nrepeat, time, tlb_misses);
+  huge_free(A_data, (size_t)S * sizeof(double));
+  delete[] A;
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat)
+{
+  // If S is undefined and N or M is undefined, set S to 2^22 or the bigger of N and M.
+  if (S == -1 && (N == -1 || M == -1))
+  {
+    S = pow(2, 22);
+    if (S < N)
+      S = N;
+    if (S < M)
+      S = M;
+  }
+
+  // If S is undefined and both N and M are defined, set S = N * M.
+  if (S == -1)
+    S = N * M;
+
+  // If both N and M are undefined, fix row length to the smaller of S and 2^10 = 1024.
+  if (N == -1 && M == -1)
+  {
+    if (S > 1024)
+    {
+      M = 1024;
+    }
+    else
+    {
+      M = S;
+    }
+  }
+
+  // If only M is undefined, set it.
+  if (M == -1)
+    M = S / N;
+
+  // If N is undefined, set it.
+  if (N == -1)
+    N = S / M;
+
+  printf("  Total size S = %d N = %d M = %d\n", S, N, M);
+
+  // Check sizes.
+  if ((S < 0) || (N < 0) || (M < 0) || (nrepeat < 0))
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if ((N * M) != S)
+  {
+    printf("  N * M != S\n");
+    exit(1);
+  }
+}
+
+double multiplyVectors(const double *a, const double *b, int size)
+{
+  double sum = 0;
+  #pragma omp simd reduction(+ : sum)
+  for (int i = 0; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+// One prefetch per cache line of a, distance bytes ahead, LOCALITY 3 is
+// prefetcht0 and 0 prefetchnta (__builtin_prefetch takes a constant, the
+// _mm_hint type of _mm_prefetch differs between compilers). The prefetches
+// past the end of the row hit the next row of the thread (A is contiguous),
+// past the end of A they are dropped by the hardware. Eight partial sums,
+// one per lane of the line, keep the loop vectorized.
+template <int LOCALITY>
+double multiplyVectorsPrefetch(const double *a, const double *b, int size, int distance)
+{
+  const char *ahead = (const char *)a + distance;
+  double acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  int i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    __builtin_prefetch(ahead + i * sizeof(double), 0, LOCALITY);
+    #pragma omp simd
+    for (int k = 0; k < 8; k++)
+    {
+      acc[k] += a[i + k] * b[i + k];
+    }
+  }
+  double sum = 0;
+  for (; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+  for (int k = 0; k < 8; k++)
+  {
+    sum += acc[k];
+  }
+
+  return sum;
+}
+
+#ifdef __AVX512F__
+// movntdqa needs aligned lines: scalar head up to the first 64 bytes
+// boundary of a, then one streaming load per line, scalar tail
+double multiplyVectorsNT(const double *a, const double *b, int size, int distance)
+{
+  double sum = 0;
+  int i = 0;
+  for (; i < size && ((uintptr_t)(a + i) & 63) != 0; i++)
+  {
+    sum += a[i] * b[i];
+  }
+  const char *ahead = (const char *)a + distance;
+  __m512d acc0 = _mm512_setzero_pd();
+  __m512d acc1 = _mm512_setzero_pd();
+  for (; i + 16 <= size; i += 16)
+  {
+    __builtin_prefetch(ahead + i * sizeof(double), 0, 0);
+    __builtin_prefetch(ahead + (i + 8) * sizeof(double), 0, 0);
+    __m512d a0 = _mm512_castsi512_pd(_mm512_stream_load_si512((void *)(a + i)));
+    __m512d a1 = _mm512_castsi512_pd(_mm512_stream_load_si512((void *)(a + i + 8)));
+    acc0 = _mm512_fmadd_pd(a0, _mm512_loadu_pd(b + i), acc0);
+    acc1 = _mm512_fmadd_pd(a1, _mm512_loadu_pd(b + i + 8), acc1);
+  }
+  for (; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum + _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
+#else
+double multiplyVectorsNT(const double *a, const double *b, int size, int distance)
+{
+  return multiplyVectorsPrefetch<0>(a, b, size, distance);
+}
+#endif
+
+// nrepeat products y^T*A*x with one kernel, returns the runtime, the dTLB
+// misses of the products go to tlb_misses
+double runKernel(int kernel, bool nta, int distance, double **A, double *x, double *y, int N, int M, int nrepeat,
+                 double &result, long long &tlb_misses)
+{
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    double sum = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+ : sum)
+    for (int i = 0; i < N; i++)
+    {
+      double row;
+      if (kernel == KERNEL_PLAIN)
+        row = multiplyVectors(A[i], x, M);
+      else if (kernel == KERNEL_NT)
+        row = multiplyVectorsNT(A[i], x, M, distance);
+      else if (nta)
+        row = multiplyVectorsPrefetch<0>(A[i], x, M, distance);
+      else
+        row = multiplyVectorsPrefetch<3>(A[i], x, M, distance);
+      sum = sum + row * y[i];
+    }
+    result = sum;
+  }
+
+  gettimeofday(&end, NULL);
+  tlb_misses = tlb.stop();
+
+  // Calculate time.
+  return 1.0 * (end.tv_sec - begin.tv_sec) +
+         1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+// Kernel name in the tuning file, the two hints of the prefetch kernel are tuned apart
+string tuningKey(int kernel, bool nta)
+{
+  return string(kernel_names[kernel]) + (nta && kernel == KERNEL_PREFETCH ? "-nta" : "");
+}
+
+// Tuning file: one "host kernel distance" line per machine and kernel,
+// the last line of a pair wins. Returns -1 when there is none.
+int readTunedDistance(const char *host, const string &key)
+{
+  ifstream myfile(TUNING_FILE);
+  string h, k;
+  int d, distance = -1;
+  while (myfile >> h >> k >> d)
+  {
+    if (h == host && k == key)
+      distance = d;
+  }
+  return distance;
+}
+
+void writeTunedDistance(const char *host, const string &key, int distance)
+{
+  ofstream myfile;
+  myfile.open(TUNING_FILE, ios_base::app);
+  myfile << host << " " << key << " " << distance << "\n";
+
+  myfile.close();
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
+
+// One line per distance of a sweep, 0 is the plain kernel
+void write_prefetch_csv(const char *host, const string &name, int nb_threads, int n, int m, int repeat, int distance,
+                        double runtime, double bandwidth)
+{
+  ofstream myfile;
+  myfile.open("stats_prefetch.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << huge_suffix() << "," << host
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << distance
+         << "," << runtime << "," << bandwidth << "\n";
+
+  myfile.close();
+}
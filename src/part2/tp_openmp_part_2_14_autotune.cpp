@@ -0,0 +1,508 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "../huge_alloc.hpp"
+
+using namespace std;
+
+// Kernels of the previous parts the tuner chooses from
+enum variant_kind
+{
+  VARIANT_SEQUENTIAL, // 2_1, no parallel region
+  VARIANT_REDUCTION,  // 2_2, parallel for reduction
+  VARIANT_SIMD        // 2_3, parallel for reduction + simd dot product
+};
+
+static const char *variant_names[] = {"sequential", "reduction", "reduction+simd"};
+
+// Loop schedules tried for the parallel kernels, applied with schedule(runtime)
+struct schedule_choice
+{
+  omp_sched_t kind;
+  int chunk;
+  const char *name;
+};
+
+static const schedule_choice schedules[] = {
+    {omp_sched_static, 0, "static"},
+    {omp_sched_dynamic, 16, "dynamic,16"},
+    {omp_sched_guided, 0, "guided"}};
+
+#define NB_SCHEDULES (int)(sizeof(schedules) / sizeof(schedules[0]))
+
+// Shapes further than this (sum of the log2 distances of N and M) from every
+// tuned shape are tuned instead of reusing the nearest decision
+#define MAX_SHAPE_DISTANCE 2
+
+// One line of the decision table: the fastest variant for a shape and a
+// thread budget
+struct tuning_entry
+{
+  int N, M, max_threads;
+  int variant, schedule, threads;
+  double time; // seconds per repetition when tuned
+};
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat);
+double multiplyVectors(double *a, double *b, int size);
+double multiplyVectorsSimd(double *a, double *b, int size);
+double runVariant(const tuning_entry &e, double **A, double *x, double *y, int N, int M, int nrepeat, double &result);
+tuning_entry tune(double **A, double *x, double *y, int N, int M, int max_threads, int nrepeat);
+vector<tuning_entry> readTuningFile(const char *file);
+void appendTuningFile(const char *file, const tuning_entry &e);
+const tuning_entry *lookup(const vector<tuning_entry> &table, int N, int M, int max_threads);
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int S = 4096 * 1024; // total size 2^22
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = omp_get_max_threads();
+  int tune_repeat = 10; // repetitions timed per candidate
+  bool retune = false;
+  const char *tuning_file = "autotune_part2.txt";
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if ((strcmp(argv[i], "-S") == 0) || (strcmp(argv[i], "-Size") == 0))
+    {
+      S = pow(2, atof(argv[++i]));
+      printf("  User S is %d\n", S);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      printf("  At most %d threads\n", nb_thread);
+    }
+    else if (strcmp(argv[i], "-tune") == 0)
+    {
+      retune = true;
+      printf("  Tune this shape again\n");
+    }
+    else if (strcmp(argv[i], "-tune_repeat") == 0)
+    {
+      tune_repeat = atoi(argv[++i]);
+      printf("  %d repetitions per candidate\n", tune_repeat);
+    }
+    else if (strcmp(argv[i], "-file") == 0)
+    {
+      tuning_file = argv[++i];
+      printf("  User tuning file is %s\n", tuning_file);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -Size (-S) <int>:      exponent num, determines total matrix size 2^num (default: 2^22 = 4096*1024 )\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -T <int>:              largest number of threads the tuner may use (default: OpenMP default)\n");
+      printf("  -tune:                 benchmark the candidates even if the shape is in the tuning file\n");
+      printf("  -tune_repeat <int>:    repetitions timed per candidate (default: 10)\n");
+      printf("  -file <name>:          tuning file (default: autotune_part2.txt)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  S = N * M;
+  // Check sizes.
+  checkSizes(N, M, S, nrepeat);
+  if (nb_thread < 1 || tune_repeat < 1)
+  {
+    printf("  Thread count and tuning repetitions must be greater than 0.\n");
+    exit(1);
+  }
+
+  // Allocate x,y,A
+  double *y = new double[N];
+  double *x = new double[M];
+  double **A = new double *[N];
+  // A is one block so its pages can be chosen, the rows point into it.
+  double *A_data = (double *)huge_alloc((size_t)N * M * sizeof(double));
+
+  for (int i = 0; i < N; i++)
+  {
+    A[i] = A_data + (size_t)i * M;
+  }
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (int i = 0; i < M; i++)
+  {
+    x[i] = 1;
+  }
+
+  // Initialize A matrix
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      A[i][j] = 1;
+    }
+  }
+
+  // Decision for this shape: from the table when it has this shape or a
+  // close one, otherwise benchmarked once and added to the table.
+  vector<tuning_entry> table = readTuningFile(tuning_file);
+  const tuning_entry *found = retune ? NULL : lookup(table, N, M, nb_thread);
+  tuning_entry choice;
+  if (found != NULL)
+  {
+    choice = *found;
+    printf("  Tuned for N( %d ) M( %d ) with %d threads in %s\n", choice.N, choice.M, choice.max_threads,
+           tuning_file);
+  }
+  else
+  {
+    choice = tune(A, x, y, N, M, nb_thread, tune_repeat);
+    appendTuningFile(tuning_file, choice);
+    printf("  Decision saved in %s\n", tuning_file);
+  }
+  printf("  Dispatch to %s, schedule %s, %d threads\n", variant_names[choice.variant],
+         schedules[choice.schedule].name, choice.threads);
+
+  print_pages("A");
+  tlb_counter tlb;
+
+  double result = 0;
+  tlb.start();
+  double time = runVariant(choice, A, x, y, N, M, nrepeat, result);
+  long long tlb_misses = tlb.stop();
+
+  // Output result.
+  printf("  Computed result for %d x %d is %lf\n", N, M, result);
+  const double solution = (double)N * (double)M;
+  if (result != solution)
+  {
+    printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+  }
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (M + (double)M * N + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  string name = string("2_14 auto ") + variant_names[choice.variant];
+  if (choice.variant != VARIANT_SEQUENTIAL)
+    name += string(" ") + schedules[choice.schedule].name;
+  write_perf_csv(name, choice.threads, N, M, nrepeat, time);
+  write_pages_csv(name, choice.threads, N, M, nrepeat, time, tlb_misses);
+  huge_free(A_data, (size_t)N * M * sizeof(double));
+  delete[] A;
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat)
+{
+  // If S is undefined and N or M is undefined, set S to 2^22 or the bigger of N and M.
+  if (S == -1 && (N == -1 || M == -1))
+  {
+    S = pow(2, 22);
+    if (S < N)
+      S = N;
+    if (S < M)
+      S = M;
+  }
+
+  // If S is undefined and both N and M are defined, set S = N * M.
+  if (S == -1)
+    S = N * M;
+
+  // If both N and M are undefined, fix row length to the smaller of S and 2^10 = 1024.
+  if (N == -1 && M == -1)
+  {
+    if (S > 1024)
+    {
+      M = 1024;
+    }
+    else
+    {
+      M = S;
+    }
+  }
+
+  // If only M is undefined, set it.
+  if (M == -1)
+    M = S / N;
+
+  // If N is undefined, set it.
+  if (N == -1)
+    N = S / M;
+
+  printf("  Total size S = %d N = %d M = %d\n", S, N, M);
+
+  // Check sizes.
+  if ((S < 0) || (N < 0) || (M < 0) || (nrepeat < 0))
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if ((N * M) != S)
+  {
+    printf("  N * M != S\n");
+    exit(1);
+  }
+}
+
+double multiplyVectors(double *a, double *b, int size)
+{
+  double sum = 0;
+  for (int i = 0; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+double multiplyVectorsSimd(double *a, double *b, int size)
+{
+  double sum = 0;
+  #pragma omp simd reduction(+ : sum)
+  for (int i = 0; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+// nrepeat products y^T*A*x with the variant of e, returns the runtime
+double runVariant(const tuning_entry &e, double **A, double *x, double *y, int N, int M, int nrepeat, double &result)
+{
+  if (e.variant != VARIANT_SEQUENTIAL)
+    omp_set_schedule(schedules[e.schedule].kind, schedules[e.schedule].chunk);
+
+  // Timer products.
+  struct timeval begin, end;
+
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    double sum = 0;
+
+    if (e.variant == VARIANT_SEQUENTIAL)
+    {
+      for (int i = 0; i < N; i++)
+      {
+        sum += multiplyVectors(A[i], x, M) * y[i];
+      }
+    }
+    else if (e.variant == VARIANT_REDUCTION)
+    {
+      #pragma omp parallel for num_threads(e.threads) schedule(runtime) reduction(+ : sum)
+      for (int i = 0; i < N; i++)
+      {
+        sum = sum + multiplyVectors(A[i], x, M) * y[i];
+      }
+    }
+    else
+    {
+      #pragma omp parallel for num_threads(e.threads) schedule(runtime) reduction(+ : sum)
+      for (int i = 0; i < N; i++)
+      {
+        sum = sum + multiplyVectorsSimd(A[i], x, M) * y[i];
+      }
+    }
+    result = sum;
+  }
+
+  gettimeofday(&end, NULL);
+
+  // Calculate time.
+  return 1.0 * (end.tv_sec - begin.tv_sec) +
+         1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+// Times every candidate on this shape: the sequential kernel, then both
+// parallel kernels with each schedule and 1, 2, 4, ... max_threads threads.
+// One untimed repetition first so that every candidate starts with a warm team.
+tuning_entry tune(double **A, double *x, double *y, int N, int M, int max_threads, int nrepeat)
+{
+  vector<tuning_entry> candidates;
+  candidates.push_back({N, M, max_threads, VARIANT_SEQUENTIAL, 0, 1, 0});
+  for (int v = VARIANT_REDUCTION; v <= VARIANT_SIMD; v++)
+  {
+    for (int s = 0; s < NB_SCHEDULES; s++)
+    {
+      for (int t = 1; ; t = min(2 * t, max_threads))
+      {
+        candidates.push_back({N, M, max_threads, v, s, t, 0});
+        if (t == max_threads)
+          break;
+      }
+    }
+  }
+
+  printf("  Tuning %zu candidates for N( %d ) M( %d ) with at most %d threads\n", candidates.size(), N, M,
+         max_threads);
+  tuning_entry best = candidates[0];
+  best.time = -1;
+  for (tuning_entry &c : candidates)
+  {
+    double result;
+    runVariant(c, A, x, y, N, M, 1, result);
+    c.time = runVariant(c, A, x, y, N, M, nrepeat, result) / nrepeat;
+    printf("    %-15s %-11s threads( %2d ) time( %g s )\n", variant_names[c.variant],
+           c.variant == VARIANT_SEQUENTIAL ? "-" : schedules[c.schedule].name, c.threads, c.time);
+    if (best.time < 0 || c.time < best.time)
+      best = c;
+  }
+  return best;
+}
+
+// Decision table, one "N M max_threads variant schedule threads time" line
+// per tuned shape. A missing file is an empty table.
+vector<tuning_entry> readTuningFile(const char *file)
+{
+  vector<tuning_entry> table;
+  ifstream myfile(file);
+  tuning_entry e;
+  while (myfile >> e.N >> e.M >> e.max_threads >> e.variant >> e.schedule >> e.threads >> e.time)
+  {
+    if (e.variant >= VARIANT_SEQUENTIAL && e.variant <= VARIANT_SIMD && e.schedule >= 0 &&
+        e.schedule < NB_SCHEDULES && e.threads >= 1)
+      table.push_back(e);
+  }
+  return table;
+}
+
+void appendTuningFile(const char *file, const tuning_entry &e)
+{
+  ofstream myfile;
+  myfile.open(file, ios_base::app);
+  myfile.precision(8);
+  myfile << e.N << " " << e.M << " " << e.max_threads << " " << e.variant << " " << e.schedule
+         << " " << e.threads << " " << e.time << "\n";
+
+  myfile.close();
+}
+
+// Closest tuned shape with the same thread budget, the latest entry wins
+// among equals so that -tune overrides. NULL when none is close enough.
+const tuning_entry *lookup(const vector<tuning_entry> &table, int N, int M, int max_threads)
+{
+  const tuning_entry *best = NULL;
+  double best_distance = MAX_SHAPE_DISTANCE;
+  for (const tuning_entry &e : table)
+  {
+    if (e.max_threads != max_threads)
+      continue;
+    double distance = fabs(log2((double)e.N / N)) + fabs(log2((double)e.M / M));
+    if (distance <= best_distance)
+    {
+      best = &e;
+      best_distance = distance;
+    }
+  }
+  return best;
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
@@ -0,0 +1,494 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include "../huge_alloc.hpp"
+
+using namespace std;
+
+// Blocks of at most TRANSPOSE_LEAF x TRANSPOSE_LEAF are transposed with a
+// plain double loop, halves of more than TRANSPOSE_TASK elements become tasks
+#define TRANSPOSE_LEAF 32
+#define TRANSPOSE_TASK (1 << 14)
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat);
+double valueAt(int i, int j);
+double multiplyAxpy(const double *A, const double *x, const double *y, int N, int M, int block, double *z_all,
+                    size_t ldz);
+double multiplyColumnDot(const double *A, const double *x, const double *y, int N, int M);
+void transpose(const double *src, double *dst, int rows, int cols);
+double seconds(const struct timeval &begin, const struct timeval &end);
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int S = 4096 * 1024; // total size 2^22
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  bool axpy = true;        // AXPY kernel, else one dot product per column
+  bool from_row = false;   // producer writes A row-major, converted once
+  int block = 2048;        // rows of the private accumulators updated per pass
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if ((strcmp(argv[i], "-S") == 0) || (strcmp(argv[i], "-Size") == 0))
+    {
+      S = pow(2, atof(argv[++i]));
+      printf("  User S is %d\n", S);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-K") == 0) || (strcmp(argv[i], "-kernel") == 0))
+    {
+      i++;
+      if (strcmp(argv[i], "axpy") == 0)
+        axpy = true;
+      else if (strcmp(argv[i], "dot") == 0)
+        axpy = false;
+      else
+      {
+        printf("  Unknown kernel %s (axpy or dot)\n", argv[i]);
+        exit(1);
+      }
+      printf("  User kernel is %s\n", argv[i]);
+    }
+    else if (strcmp(argv[i], "-from") == 0)
+    {
+      i++;
+      if (strcmp(argv[i], "row") == 0)
+        from_row = true;
+      else if (strcmp(argv[i], "col") == 0)
+        from_row = false;
+      else
+      {
+        printf("  Unknown layout %s (row or col)\n", argv[i]);
+        exit(1);
+      }
+      printf("  A is produced %s-major\n", argv[i]);
+    }
+    else if ((strcmp(argv[i], "-B") == 0) || (strcmp(argv[i], "-block") == 0))
+    {
+      block = atoi(argv[++i]);
+      printf("  User row block is %d\n", block);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x with A column-major Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -Size (-S) <int>:      exponent num, determines total matrix size 2^num (default: 2^22 = 4096*1024 )\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -kernel (-K) <name>:   axpy (y . (A x) by column updates) or dot ((A^T y) . x) (default: axpy)\n");
+      printf("  -from <name>:          layout written by the producer, col or row (transposed once) (default: col)\n");
+      printf("  -block (-B) <int>:     rows of the accumulators per pass of the axpy kernel (default: 2048)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  S = N * M;
+  // Check sizes.
+  checkSizes(N, M, S, nrepeat);
+  if (block < 8)
+  {
+    printf("  The row block must be at least 8.\n");
+    exit(1);
+  }
+
+  // Allocate x,y,A. A is one block, column j starts at A + j * N.
+  double *y = new double[N];
+  double *x = new double[M];
+  double *A = (double *)huge_alloc((size_t)S * sizeof(double));
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (int i = 0; i < M; i++)
+  {
+    x[i] = 1;
+  }
+
+  // Initialize A matrix. The values are small integers so that every
+  // partial sum is exact and any summation order gives the solution.
+  double transpose_time = 0;
+  if (from_row)
+  {
+    double *R = (double *)huge_alloc((size_t)S * sizeof(double));
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < N; i++)
+    {
+      for (int j = 0; j < M; j++)
+      {
+        R[(size_t)i * M + j] = valueAt(i, j);
+      }
+    }
+
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
+    transpose(R, A, N, M);
+    gettimeofday(&end, NULL);
+    transpose_time = seconds(begin, end);
+    printf("  Transpose to column-major in %g s ( %g GB/s )\n", transpose_time,
+           2.0e-9 * sizeof(double) * (double)S / transpose_time);
+    huge_free(R, (size_t)S * sizeof(double));
+  }
+  else
+  {
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < M; j++)
+    {
+      for (int i = 0; i < N; i++)
+      {
+        A[(size_t)j * N + i] = valueAt(i, j);
+      }
+    }
+  }
+
+  double solution = 0;
+  #pragma omp parallel for reduction(+ : solution)
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      solution += valueAt(i, j);
+    }
+  }
+
+  // One accumulator vector of N doubles per thread, rounded to cache lines
+  size_t ldz = ((size_t)N + 7) / 8 * 8;
+  double *z_all = axpy ? new double[ldz * omp_get_max_threads()] : NULL;
+
+  print_pages("A");
+
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  double result = 0;
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    if (axpy)
+      result = multiplyAxpy(A, x, y, N, M, block, z_all, ldz);
+    else
+      result = multiplyColumnDot(A, x, y, N, M);
+
+    if (result != solution)
+    {
+      printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+    }
+  }
+
+  gettimeofday(&end, NULL);
+  long long tlb_misses = tlb.stop();
+
+  // Output result.
+  printf("  Computed result for %d x %d is %lf\n", N, M, result);
+
+  // Calculate time.
+  double time = seconds(begin, end);
+
+  // Calculate bandwidth.
+  // Each matrix A column (each of length N) is read once.
+  // The x vector (of length M) is read once.
+  // The y vector (of length N) is read once (axpy) or M times (dot).
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (M + (double)M * N + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  if (from_row)
+    printf("  The transpose costs %g repetitions\n", transpose_time * nrepeat / time);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  write_perf_csv(axpy ? "2_15 colmajor axpy" : "2_15 colmajor dot", nb_thread, N, M, nrepeat, time);
+  write_pages_csv(axpy ? "2_15 colmajor axpy" : "2_15 colmajor dot", nb_thread, N, M, nrepeat, time, tlb_misses);
+  if (from_row)
+    write_perf_csv("2_15 transpose", nb_thread, N, M, 1, transpose_time);
+  delete[] z_all;
+  huge_free(A, (size_t)S * sizeof(double));
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat)
+{
+  // If S is undefined and N or M is undefined, set S to 2^22 or the bigger of N and M.
+  if (S == -1 && (N == -1 || M == -1))
+  {
+    S = pow(2, 22);
+    if (S < N)
+      S = N;
+    if (S < M)
+      S = M;
+  }
+
+  // If S is undefined and both N and M are defined, set S = N * M.
+  if (S == -1)
+    S = N * M;
+
+  // If both N and M are undefined, fix row length to the smaller of S and 2^10 = 1024.
+  if (N == -1 && M == -1)
+  {
+    if (S > 1024)
+    {
+      M = 1024;
+    }
+    else
+    {
+      M = S;
+    }
+  }
+
+  // If only M is undefined, set it.
+  if (M == -1)
+    M = S / N;
+
+  // If N is undefined, set it.
+  if (N == -1)
+    N = S / M;
+
+  printf("  Total size S = %d N = %d M = %d\n", S, N, M);
+
+  // Check sizes.
+  if ((S < 0) || (N < 0) || (M < 0) || (nrepeat < 0))
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if ((N * M) != S)
+  {
+    printf("  N * M != S\n");
+    exit(1);
+  }
+}
+
+// Integers in [0, 15], a transpose that moves a value shows in the result
+double valueAt(int i, int j)
+{
+  return (double)((i + 3 * j) % 16);
+}
+
+// y . (A x) with A column-major: each thread streams its columns and adds
+// x[j] * A[:, j] into its own accumulator z, a block of rows at a time so
+// that z stays in cache. The private vectors are then summed row by row.
+double multiplyAxpy(const double *A, const double *x, const double *y, int N, int M, int block, double *z_all,
+                    size_t ldz)
+{
+  double result = 0;
+
+  #pragma omp parallel
+  {
+    int T = omp_get_num_threads();
+    double *z = z_all + (size_t)omp_get_thread_num() * ldz;
+
+    for (int i = 0; i < N; i++)
+    {
+      z[i] = 0;
+    }
+
+    // Same static partition of the columns for every block, no barrier needed
+    for (int ib = 0; ib < N; ib += block)
+    {
+      int ie = min(ib + block, N);
+      #pragma omp for schedule(static) nowait
+      for (int j = 0; j < M; j++)
+      {
+        const double *col = A + (size_t)j * N;
+        double xj = x[j];
+        #pragma omp simd
+        for (int i = ib; i < ie; i++)
+        {
+          z[i] += xj * col[i];
+        }
+      }
+    }
+
+    #pragma omp barrier
+
+    #pragma omp for schedule(static) reduction(+ : result)
+    for (int i = 0; i < N; i++)
+    {
+      double sum = 0;
+      for (int t = 0; t < T; t++)
+      {
+        sum += z_all[(size_t)t * ldz + i];
+      }
+      result += sum * y[i];
+    }
+  }
+
+  return result;
+}
+
+// (A^T y) . x with A column-major: one contiguous dot product per column
+double multiplyColumnDot(const double *A, const double *x, const double *y, int N, int M)
+{
+  double result = 0;
+
+  #pragma omp parallel for schedule(static) reduction(+ : result)
+  for (int j = 0; j < M; j++)
+  {
+    const double *col = A + (size_t)j * N;
+    double sum = 0;
+    #pragma omp simd reduction(+ : sum)
+    for (int i = 0; i < N; i++)
+    {
+      sum += col[i] * y[i];
+    }
+    result += sum * x[j];
+  }
+
+  return result;
+}
+
+// dst[j][i] = src[i][j] for a rows x cols block, lds and ldd the row lengths
+// of the whole matrices. Halves the longer side until the block fits in L1,
+// whatever the cache sizes are.
+void transposeBlock(const double *src, double *dst, int rows, int cols, size_t lds, size_t ldd)
+{
+  if (rows <= TRANSPOSE_LEAF && cols <= TRANSPOSE_LEAF)
+  {
+    for (int i = 0; i < rows; i++)
+    {
+      for (int j = 0; j < cols; j++)
+      {
+        dst[(size_t)j * ldd + i] = src[(size_t)i * lds + j];
+      }
+    }
+    return;
+  }
+
+  if (rows >= cols)
+  {
+    int half = rows / 2;
+    #pragma omp task if ((size_t)half * cols > TRANSPOSE_TASK)
+    transposeBlock(src, dst, half, cols, lds, ldd);
+    transposeBlock(src + (size_t)half * lds, dst + half, rows - half, cols, lds, ldd);
+  }
+  else
+  {
+    int half = cols / 2;
+    #pragma omp task if ((size_t)rows * half > TRANSPOSE_TASK)
+    transposeBlock(src, dst, rows, half, lds, ldd);
+    transposeBlock(src + half, dst + (size_t)half * ldd, rows, cols - half, lds, ldd);
+  }
+  #pragma omp taskwait
+}
+
+// Row-major rows x cols to column-major (or the reverse with the sizes swapped)
+void transpose(const double *src, double *dst, int rows, int cols)
+{
+  #pragma omp parallel
+  #pragma omp single
+  transposeBlock(src, dst, rows, cols, cols, rows);
+}
+
+double seconds(const struct timeval &begin, const struct timeval &end)
+{
+  return 1.0 * (end.tv_sec - begin.tv_sec) +
+         1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
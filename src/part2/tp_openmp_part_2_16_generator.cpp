@@ -0,0 +1,421 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include "../generator.hpp"
+#include "../huge_alloc.hpp"
+
+using namespace std;
+
+// Relative difference to the reference above which the result is an error,
+// the summation order of the kernels differs from the one of the reference
+#define TOL 1e-10
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat);
+double multiplyStored(const double *A, const double *x, const double *y, int N, int M);
+double multiplyOnTheFly(const generator &gen, const double *x, const double *y, int N, int M);
+double seconds(const struct timeval &begin, const struct timeval &end);
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+void write_generator_csv(const string &name, const generator &gen, bool on_the_fly, int nb_threads, int rows,
+                         int cols, int inner, int repeat, double init_time, double runtime);
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int S = 4096 * 1024; // total size 2^22
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  generator gen;
+  bool on_the_fly = false; // A is never stored, the kernel evaluates it
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if ((strcmp(argv[i], "-S") == 0) || (strcmp(argv[i], "-Size") == 0))
+    {
+      S = pow(2, atof(argv[++i]));
+      printf("  User S is %d\n", S);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if (strcmp(argv[i], "-gen") == 0)
+    {
+      gen.kind = parse_generator(argv[++i]);
+      printf("  User generator is %s\n", gen.name());
+    }
+    else if (strcmp(argv[i], "-mode") == 0)
+    {
+      i++;
+      if (strcmp(argv[i], "fill") == 0)
+        on_the_fly = false;
+      else if (strcmp(argv[i], "fly") == 0)
+        on_the_fly = true;
+      else
+      {
+        printf("  Unknown mode %s (fill or fly)\n", argv[i]);
+        exit(1);
+      }
+      printf("  User mode is %s\n", argv[i]);
+    }
+    else if (strcmp(argv[i], "-seed") == 0)
+    {
+      gen.seed = strtoull(argv[++i], NULL, 10);
+      printf("  User seed is %llu\n", (unsigned long long)gen.seed);
+    }
+    else if (strcmp(argv[i], "-band") == 0)
+    {
+      gen.band = atol(argv[++i]);
+      printf("  User band is %zu\n", gen.band);
+    }
+    else if (strcmp(argv[i], "-value") == 0)
+    {
+      gen.value = atof(argv[++i]);
+      printf("  User value is %g\n", gen.value);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -Size (-S) <int>:      exponent num, determines total matrix size 2^num (default: 2^22 = 4096*1024 )\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -gen <name>:           A is constant, random, banded or toeplitz (default: constant)\n");
+      printf("  -mode <name>:          fill A in parallel before the kernel, or evaluate it on the fly (default: fill)\n");
+      printf("  -seed <int>:           seed of the random and toeplitz generators (default: 42)\n");
+      printf("  -band <int>:           half width of the banded generator (default: 2)\n");
+      printf("  -value <double>:       value of the constant generator, diagonal of the banded one (default: 1)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  S = N * M;
+  // Check sizes.
+  checkSizes(N, M, S, nrepeat);
+
+  // Allocate x,y and, unless it is evaluated on the fly, A
+  double *y = new double[N];
+  double *x = new double[M];
+  double *A = NULL;
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (int i = 0; i < M; i++)
+  {
+    x[i] = 1;
+  }
+
+  // Initialize A matrix
+  struct timeval begin, end;
+  double init_time = 0;
+  if (!on_the_fly)
+  {
+    gettimeofday(&begin, NULL);
+    A = (double *)huge_alloc((size_t)S * sizeof(double));
+    generate(A, N, M, M, gen);
+    gettimeofday(&end, NULL);
+    init_time = seconds(begin, end);
+    printf("  A generated in %g s\n", init_time);
+  }
+
+  // Reference: exact for the constant matrix, otherwise in long double
+  double solution = (double)N * (double)M * gen.value;
+  if (gen.kind != GEN_CONSTANT)
+  {
+    long double sum = 0;
+    #pragma omp parallel for reduction(+ : sum)
+    for (int i = 0; i < N; i++)
+    {
+      for (int j = 0; j < M; j++)
+      {
+        sum += gen(i, j);
+      }
+    }
+    solution = (double)sum;
+  }
+
+  if (!on_the_fly)
+    print_pages("A");
+
+  // Timer products.
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  double result = 0;
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    if (on_the_fly)
+      result = multiplyOnTheFly(gen, x, y, N, M);
+    else
+      result = multiplyStored(A, x, y, N, M);
+  }
+
+  gettimeofday(&end, NULL);
+  long long tlb_misses = tlb.stop();
+
+  // Output result.
+  printf("  Computed result for %d x %d is %lf\n", N, M, result);
+  if (fabs(result - solution) > TOL * fmax(1.0, fabs(solution)))
+  {
+    printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+  }
+
+  // Calculate time.
+  double time = seconds(begin, end);
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once, unless it is generated.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  double Gbytes = 1.0e-9 * double(sizeof(double) * ((on_the_fly ? 0 : (double)M * N) + M + N));
+  double Gelems = 1.0e-9 * (double)N * M;
+
+  // Print results (problem size, time, bandwidth in GB/s and elements of A per second).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s ) elements( %g G/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time, Gelems * nrepeat / time);
+  if (!on_the_fly)
+    printf("  Generating A took %g repetitions\n", init_time * nrepeat / time);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  string base = string("2_16 ") + gen.name() + (on_the_fly ? " fly" : " fill");
+  string name = base + (on_the_fly ? "" : huge_suffix());
+  write_perf_csv(name, nb_thread, N, M, nrepeat, time);
+  write_pages_csv(base, nb_thread, N, M, nrepeat, time, tlb_misses);
+  write_generator_csv(name, gen, on_the_fly, nb_thread, N, 1, M, nrepeat, init_time, time);
+  huge_free(A, (size_t)S * sizeof(double));
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat)
+{
+  // If S is undefined and N or M is undefined, set S to 2^22 or the bigger of N and M.
+  if (S == -1 && (N == -1 || M == -1))
+  {
+    S = pow(2, 22);
+    if (S < N)
+      S = N;
+    if (S < M)
+      S = M;
+  }
+
+  // If S is undefined and both N and M are defined, set S = N * M.
+  if (S == -1)
+    S = N * M;
+
+  // If both N and M are undefined, fix row length to the smaller of S and 2^10 = 1024.
+  if (N == -1 && M == -1)
+  {
+    if (S > 1024)
+    {
+      M = 1024;
+    }
+    else
+    {
+      M = S;
+    }
+  }
+
+  // If only M is undefined, set it.
+  if (M == -1)
+    M = S / N;
+
+  // If N is undefined, set it.
+  if (N == -1)
+    N = S / M;
+
+  printf("  Total size S = %d N = %d M = %d\n", S, N, M);
+
+  // Check sizes.
+  if ((S < 0) || (N < 0) || (M < 0) || (nrepeat < 0))
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if ((N * M) != S)
+  {
+    printf("  N * M != S\n");
+    exit(1);
+  }
+}
+
+// y^T*A*x with A stored row-major
+double multiplyStored(const double *A, const double *x, const double *y, int N, int M)
+{
+  double result = 0;
+
+  #pragma omp parallel for schedule(static) reduction(+ : result)
+  for (int i = 0; i < N; i++)
+  {
+    const double *row = A + (size_t)i * M;
+    double sum = 0;
+    #pragma omp simd reduction(+ : sum)
+    for (int j = 0; j < M; j++)
+    {
+      sum += row[j] * x[j];
+    }
+    result += sum * y[i];
+  }
+
+  return result;
+}
+
+// y^T*A*x with A(i, j) computed where it is used, only over the columns
+// that can be nonzero (the band of a banded matrix)
+template <int KIND>
+double multiplyOnTheFly(const generator &gen, const double *x, const double *y, int N, int M)
+{
+  double result = 0;
+
+  #pragma omp parallel for schedule(static) reduction(+ : result)
+  for (int i = 0; i < N; i++)
+  {
+    size_t jb = gen.col_begin(i), je = gen.col_end(i, M);
+    double sum = 0;
+    #pragma omp simd reduction(+ : sum)
+    for (size_t j = jb; j < je; j++)
+    {
+      sum += gen.at<KIND>(i, j) * x[j];
+    }
+    result += sum * y[i];
+  }
+
+  return result;
+}
+
+double multiplyOnTheFly(const generator &gen, const double *x, const double *y, int N, int M)
+{
+  switch (gen.kind)
+  {
+  case GEN_RANDOM:
+    return multiplyOnTheFly<GEN_RANDOM>(gen, x, y, N, M);
+  case GEN_BANDED:
+    return multiplyOnTheFly<GEN_BANDED>(gen, x, y, N, M);
+  case GEN_TOEPLITZ:
+    return multiplyOnTheFly<GEN_TOEPLITZ>(gen, x, y, N, M);
+  default:
+    return multiplyOnTheFly<GEN_CONSTANT>(gen, x, y, N, M);
+  }
+}
+
+double seconds(const struct timeval &begin, const struct timeval &end)
+{
+  return 1.0 * (end.tv_sec - begin.tv_sec) +
+         1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
+
+// Shared with part 4: a GEMV is rows x 1 with inner dimension M
+void write_generator_csv(const string &name, const generator &gen, bool on_the_fly, int nb_threads, int rows,
+                         int cols, int inner, int repeat, double init_time, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_generator.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name << "," << gen.name() << "," << (on_the_fly ? "fly" : "fill")
+         << "," << nb_threads << "," << rows << "," << cols << "," << inner << "," << repeat
+         << "," << init_time << "," << runtime << "\n";
+
+  myfile.close();
+}
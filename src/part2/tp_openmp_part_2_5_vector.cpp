@@ -0,0 +1,371 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include "../huge_alloc.hpp"
+
+using namespace std;
+void checkSizes(int &N, int &M, int &S, int &nrepeat);
+void multiplyRowBatch(const double *a, const double *X, double *t, int M, int K);
+void write_perf_csv(int nb_threads, int k, int n, int m, int repeat, double runtime);
+
+// Upper bound of the number of (x, y) pairs evaluated in one pass
+#define MAX_PAIRS 64
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int S = 4096 * 1024; // total size 2^22
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  int K = 8;           // number of (x, y) pairs
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if ((strcmp(argv[i], "-S") == 0) || (strcmp(argv[i], "-Size") == 0))
+    {
+      S = pow(2, atof(argv[++i]));
+      printf("  User S is %d\n", S);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-K") == 0) || (strcmp(argv[i], "-pairs") == 0))
+    {
+      K = atoi(argv[++i]);
+      if (K < 1 || K > MAX_PAIRS)
+      {
+        printf("  Number of pairs must be between 1 and %d\n", MAX_PAIRS);
+        exit(1);
+      }
+      printf("  User K is %d\n", K);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -Size (-S) <int>:      exponent num, determines total matrix size 2^num (default: 2^22 = 4096*1024 )\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -pairs (-K) <int>:     number of (x, y) pairs evaluated per pass over A (default: 8)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  S = N * M;
+  // Check sizes.
+  checkSizes(N, M, S, nrepeat);
+
+  // Allocate X,Y,A, the K vectors are interleaved: X[j * K + p] is x_p[j]
+  double *Y = new double[N * K];
+  double *X = new double[M * K];
+  double **A = new double *[N];
+
+  // A is one block so its pages can be chosen, the rows point into it.
+  double *A_data = (double *)huge_alloc((size_t)N * M * sizeof(double));
+
+  for (int i = 0; i < N; i++)
+  {
+    A[i] = A_data + (size_t)i * M;
+  }
+
+  // Initialize every y_p vector to 1.
+  for (int i = 0; i < N * K; i++)
+  {
+    Y[i] = 1;
+  }
+
+  // Initialize x_p vector to p + 1 so each pair has its own solution.
+  for (int j = 0; j < M; j++)
+  {
+    for (int p = 0; p < K; p++)
+    {
+      X[j * K + p] = p + 1;
+    }
+  }
+
+  // Initialize A matrix, you can use a 1D index if you want a flat structure (i.e. a 1D array) e.g. j*M+i is the same than [j][i]
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      A[i][j] = 1;
+    }
+  }
+
+  print_pages("A");
+
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    // For each line i
+    // Multiply the i lines with the vector x
+    // Sum the results of the previous step into a single variable
+    // Multiply the result of the previous step with the i value of vector y
+    // Sum the results of the previous step into a single variable (result)
+    // A is streamed once for the K pairs: each A[i][j] loaded is multiplied
+    // by the K values x_p[j], then the K row products are scaled by y_p[i]
+    double result[MAX_PAIRS] = {0};
+
+    #pragma omp parallel for reduction(+ : result[:K])
+    for (int i = 0; i < N; i++)
+    {
+      double t[MAX_PAIRS];
+      multiplyRowBatch(A[i], X, t, M, K);
+      for (int p = 0; p < K; p++)
+      {
+        result[p] += t[p] * Y[i * K + p];
+      }
+    }
+    // Output result.
+    if (repeat == (nrepeat - 1))
+    {
+      for (int p = 0; p < K; p++)
+      {
+        printf("  Computed result for pair %d of %d x %d is %lf\n", p, N, M, result[p]);
+      }
+    }
+
+    for (int p = 0; p < K; p++)
+    {
+      const double solution = (double)N * (double)M * (double)(p + 1);
+
+      if (result[p] != solution)
+      {
+        printf("  Error: pair %d result( %lf ) != solution( %lf )\n", p, result[p], solution);
+      }
+    }
+  }
+
+  gettimeofday(&end, NULL);
+  long long tlb_misses = tlb.stop();
+
+  // Calculate time.
+  // double time = timer.seconds();
+  double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+  // Calculate bandwidth.
+  // The matrix A is read once per pass whatever K is.
+  // The X vectors (K * M) are read N times, mostly from cache.
+  // The Y vectors (K * N) are read once.
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (K * M + M * N + K * N));
+  // Evaluating the pairs one by one would read A K times.
+  double Gbytes_unbatched = 1.0e-9 * double(sizeof(double) * K * (M + M * N + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) K( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, K, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  // Effective bandwidth is what the unbatched kernel would need to match this time.
+  printf("  effective bandwidth( %g GB/s ) time per pair( %g s ) DRAM traffic saved per pair( %g MB )\n",
+         Gbytes_unbatched * nrepeat / time, time / K, (Gbytes_unbatched - Gbytes) * 1000 / K);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  write_perf_csv(nb_thread, K, N, M, nrepeat, time);
+  write_pages_csv("2_5 batched " + to_string(K) + " pairs", nb_thread, N, M, nrepeat, time, tlb_misses);
+  huge_free(A_data, (size_t)N * M * sizeof(double));
+  delete[] A;
+  delete[] Y;
+  delete[] X;
+
+  return 0;
+}
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat)
+{
+  // If S is undefined and N or M is undefined, set S to 2^22 or the bigger of N and M.
+  if (S == -1 && (N == -1 || M == -1))
+  {
+    S = pow(2, 22);
+    if (S < N)
+      S = N;
+    if (S < M)
+      S = M;
+  }
+
+  // If S is undefined and both N and M are defined, set S = N * M.
+  if (S == -1)
+    S = N * M;
+
+  // If both N and M are undefined, fix row length to the smaller of S and 2^10 = 1024.
+  if (N == -1 && M == -1)
+  {
+    if (S > 1024)
+    {
+      M = 1024;
+    }
+    else
+    {
+      M = S;
+    }
+  }
+
+  // If only M is undefined, set it.
+  if (M == -1)
+    M = S / N;
+
+  // If N is undefined, set it.
+  if (N == -1)
+    N = S / M;
+
+  printf("  Total size S = %d N = %d M = %d\n", S, N, M);
+
+  // Check sizes.
+  if ((S < 0) || (N < 0) || (M < 0) || (nrepeat < 0))
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if ((N * M) != S)
+  {
+    printf("  N * M != S\n");
+    exit(1);
+  }
+}
+
+// t[p] = A row . x_p for KB consecutive pairs of the K interleaved vectors
+// of X. KB is a constant so the accumulators stay in registers across the
+// j loop (one AVX-512 register for 8 pairs) and each a[j] is loaded once.
+template <int KB>
+void multiplyRowPairs(const double *a, const double *X, double *t, int M, int K)
+{
+  double acc[KB] = {0};
+  for (int j = 0; j < M; j++)
+  {
+    double aj = a[j];
+    const double *xj = X + (size_t)j * K;
+    #pragma omp simd
+    for (int p = 0; p < KB; p++)
+    {
+      acc[p] += aj * xj[p];
+    }
+  }
+  for (int p = 0; p < KB; p++)
+  {
+    t[p] = acc[p];
+  }
+}
+
+// t[p] = A row . x_p for the K pairs, by groups of 8, then 4, 2 and 1 for
+// the rest. Beyond 8 pairs the row is read again per group, from L1.
+void multiplyRowBatch(const double *a, const double *X, double *t, int M, int K)
+{
+  int p = 0;
+  for (; p + 8 <= K; p += 8)
+  {
+    multiplyRowPairs<8>(a, X + p, t + p, M, K);
+  }
+  if (p + 4 <= K)
+  {
+    multiplyRowPairs<4>(a, X + p, t + p, M, K);
+    p += 4;
+  }
+  if (p + 2 <= K)
+  {
+    multiplyRowPairs<2>(a, X + p, t + p, M, K);
+    p += 2;
+  }
+  if (p < K)
+  {
+    multiplyRowPairs<1>(a, X + p, t + p, M, K);
+  }
+}
+
+void write_perf_csv(int nb_threads, int k, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << "2_5 batched " << k << " pairs" << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
@@ -0,0 +1,612 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// Compressed sparse row storage
+struct csr_matrix
+{
+  int N, M;
+  vector<int> row_ptr; // N + 1 offsets in col and val
+  vector<int> col;
+  vector<double> val;
+};
+
+// SELL-C-sigma storage: rows are sorted by length inside windows of sigma
+// rows, then packed C by C in chunks padded to their longest row. A chunk is
+// stored column-major, so the C rows of a chunk are processed as one vector.
+struct sell_matrix
+{
+  int N, M, C, sigma;
+  int nchunks;
+  vector<int> chunk_ptr; // nchunks + 1 offsets in col and val
+  vector<int> chunk_len; // longest row of each chunk
+  vector<int> perm;      // original row of each slot, -1 for padding rows
+  vector<int> col;
+  vector<double> val;
+};
+
+// Upper bound of the SELL chunk height
+#define MAX_C 64
+
+void load_mtx(const char *file, csr_matrix &A);
+void generate_csr(int N, int M, int nnz_row, csr_matrix &A);
+void csr_to_sell(const csr_matrix &A, int C, int sigma, sell_matrix &S);
+void partition(const vector<int64_t> &prefix, int parts, vector<int> &bounds);
+double multiplyCSR(const csr_matrix &A, const double *x, const double *y, const vector<int> &bounds);
+double multiplySELL(const sell_matrix &S, const double *x, const double *y, const vector<int> &bounds);
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime);
+
+int main(int argc, char *argv[])
+{
+  int N = 65536;       // number of rows 2^16
+  int M = 65536;       // number of columns 2^16
+  int nnz_row = 16;    // average non zeros per generated row
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  bool sell = false;   // CSR or SELL-C-sigma
+  bool balance = true; // partition the rows by non zeros or by count
+  int C = 8;
+  int sigma = 256;
+  const char *input = NULL;
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if (strcmp(argv[i], "-nnz") == 0)
+    {
+      nnz_row = atoi(argv[++i]);
+      printf("  User nnz per row is %d\n", nnz_row);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-F") == 0) || (strcmp(argv[i], "-format") == 0))
+    {
+      i++;
+      if (strcmp(argv[i], "csr") == 0)
+        sell = false;
+      else if (strcmp(argv[i], "sell") == 0)
+        sell = true;
+      else
+      {
+        printf("  Unknown format %s\n", argv[i]);
+        exit(1);
+      }
+      printf("  User format is %s\n", argv[i]);
+    }
+    else if (strcmp(argv[i], "-C") == 0)
+    {
+      C = atoi(argv[++i]);
+      if (C < 1 || C > MAX_C)
+      {
+        printf("  Chunk height must be between 1 and %d\n", MAX_C);
+        exit(1);
+      }
+      printf("  User C is %d\n", C);
+    }
+    else if (strcmp(argv[i], "-sigma") == 0)
+    {
+      sigma = atoi(argv[++i]);
+      printf("  User sigma is %d\n", sigma);
+    }
+    else if ((strcmp(argv[i], "-P") == 0) || (strcmp(argv[i], "-partition") == 0))
+    {
+      i++;
+      if (strcmp(argv[i], "nnz") == 0)
+        balance = true;
+      else if (strcmp(argv[i], "rows") == 0)
+        balance = false;
+      else
+      {
+        printf("  Unknown partition %s\n", argv[i]);
+        exit(1);
+      }
+      printf("  User partition is %s\n", argv[i]);
+    }
+    else if ((strcmp(argv[i], "-I") == 0) || (strcmp(argv[i], "-input") == 0))
+    {
+      input = argv[++i];
+      printf("  User input is %s\n", input);
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  sparse y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^16 = 65536)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^16 = 65536)\n");
+      printf("  -nnz <int>:            average non zeros per generated row (default: 16)\n");
+      printf("  -input (-I) <file>:    Matrix Market (.mtx) file used instead of the generated matrix\n");
+      printf("  -format (-F) <name>:   csr or sell (default: csr)\n");
+      printf("  -C <int>:              SELL chunk height (default: 8)\n");
+      printf("  -sigma <int>:          SELL sorting window in rows (default: 256)\n");
+      printf("  -partition (-P) <name>: nnz (same non zeros per thread) or rows (same rows per thread), default nnz\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  if (N < 1 || M < 1 || nnz_row < 1 || nrepeat < 0 || sigma < 1)
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  csr_matrix A;
+  if (input != NULL)
+    load_mtx(input, A);
+  else
+    generate_csr(N, M, nnz_row, A);
+  N = A.N;
+  M = A.M;
+  int64_t nnz = A.row_ptr[N];
+
+  sell_matrix S;
+  if (sell)
+    csr_to_sell(A, C, sigma, S);
+
+  // Allocate x,y
+  double *y = new double[N];
+  double *x = new double[M];
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (int i = 0; i < M; i++)
+  {
+    x[i] = 1;
+  }
+
+  // Work of each unit (row for CSR, chunk for SELL) as a prefix sum, the
+  // threads get contiguous units of about the same non zeros (or count)
+  int units = sell ? S.nchunks : N;
+  vector<int64_t> prefix(units + 1, 0);
+  for (int u = 0; u < units; u++)
+  {
+    int64_t w = 1;
+    if (balance)
+      w = sell ? (int64_t)S.chunk_len[u] * C : A.row_ptr[u + 1] - A.row_ptr[u];
+    prefix[u + 1] = prefix[u] + w;
+  }
+  vector<int> bounds;
+  partition(prefix, nb_thread, bounds);
+
+  // Reference, y^T*A*x computed sequentially in the original row order.
+  double solution = 0;
+  for (int i = 0; i < N; i++)
+  {
+    double sum = 0;
+    for (int k = A.row_ptr[i]; k < A.row_ptr[i + 1]; k++)
+    {
+      sum += A.val[k] * x[A.col[k]];
+    }
+    solution += sum * y[i];
+  }
+
+  printf("  N( %d ) M( %d ) nnz( %ld ) nnz per row( %g )\n", N, M, (long)nnz, (double)nnz / N);
+  if (sell)
+  {
+    printf("  SELL-%d-%d padding( %g %% )\n", C, sigma, 100.0 * (S.chunk_ptr[S.nchunks] - nnz) / S.chunk_ptr[S.nchunks]);
+  }
+
+  // Timer products.
+  struct timeval begin, end;
+
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    double result;
+    if (sell)
+      result = multiplySELL(S, x, y, bounds);
+    else
+      result = multiplyCSR(A, x, y, bounds);
+
+    // Output result.
+    if (repeat == (nrepeat - 1))
+    {
+      printf("  Computed result for %d x %d is %lf\n", N, M, result);
+    }
+
+    // Summation order differs from the reference, loaded values may not be integers
+    if (fabs(result - solution) > 1e-9 * fabs(solution) + 1e-12)
+    {
+      printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+    }
+  }
+
+  gettimeofday(&end, NULL);
+
+  // Calculate time.
+  double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+  // Calculate bandwidth.
+  // Each stored value and its column index are read once (padding included for SELL).
+  // The row (or chunk) offsets are read once.
+  // The x vector is gathered once per non zero, the y vector is read once.
+  int64_t stored = sell ? S.chunk_ptr[S.nchunks] : nnz;
+  int64_t offsets = sell ? 2 * S.nchunks + N : N + 1;
+  double Gbytes = 1.0e-9 * double((sizeof(double) + sizeof(int)) * stored + sizeof(int) * offsets +
+                                  sizeof(double) * (nnz + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s ) GFLOPS( %g )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time, 2.0e-9 * (nnz + N) * nrepeat / time);
+
+  // Non zeros of the most loaded thread over the mean, 1 is a perfect balance
+  int64_t heaviest = 0;
+  for (int t = 0; t < nb_thread; t++)
+  {
+    int64_t w = 0;
+    for (int u = bounds[t]; u < bounds[t + 1]; u++)
+      w += sell ? (int64_t)S.chunk_len[u] * C : A.row_ptr[u + 1] - A.row_ptr[u];
+    heaviest = max(heaviest, w);
+  }
+  printf("  load imbalance( %g )\n", (double)heaviest * nb_thread / stored);
+
+  string name = string("2_6 sparse ") + (sell ? "sell-" + to_string(C) + "-" + to_string(sigma) : string("csr")) +
+                (balance ? "" : " rows");
+  write_perf_csv(name, nb_thread, N, M, nrepeat, time);
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+// Reads a coordinate Matrix Market file (real, integer or pattern entries,
+// general, symmetric or skew-symmetric) and converts it to CSR.
+void load_mtx(const char *file, csr_matrix &A)
+{
+  ifstream in(file);
+  if (!in.good())
+  {
+    printf("  Cannot open %s\n", file);
+    exit(1);
+  }
+
+  // Banner: %%MatrixMarket matrix <format> <field> <symmetry>, case insensitive
+  string line, banner, object, format, field, symmetry;
+  getline(in, line);
+  transform(line.begin(), line.end(), line.begin(), ::tolower);
+  istringstream(line) >> banner >> object >> format >> field >> symmetry;
+  if (banner != "%%matrixmarket" || object != "matrix" || format != "coordinate")
+  {
+    printf("  %s is not a coordinate Matrix Market file\n", file);
+    exit(1);
+  }
+  if (field != "real" && field != "integer" && field != "pattern")
+  {
+    printf("  Entries of type %s are not supported (real, integer or pattern)\n", field.c_str());
+    exit(1);
+  }
+  if (symmetry != "general" && symmetry != "symmetric" && symmetry != "skew-symmetric")
+  {
+    printf("  Symmetry %s is not supported (general, symmetric or skew-symmetric)\n", symmetry.c_str());
+    exit(1);
+  }
+  bool pattern = field == "pattern";
+  bool symmetric = symmetry != "general";
+  // The mirrored entry of a skew-symmetric matrix is -v
+  double mirror = symmetry == "skew-symmetric" ? -1 : 1;
+
+  // Skip the comments.
+  while (getline(in, line) && line[0] == '%')
+    ;
+  int64_t entries;
+  if (!(istringstream(line) >> A.N >> A.M >> entries) || A.N < 1 || A.M < 1 || entries < 0)
+  {
+    printf("  %s has no valid size line\n", file);
+    exit(1);
+  }
+
+  vector<int> rows, cols;
+  vector<double> vals;
+  rows.reserve(symmetric ? 2 * entries : entries);
+  for (int64_t e = 0; e < entries; e++)
+  {
+    int i, j;
+    double v = 1;
+    in >> i >> j;
+    if (!pattern)
+      in >> v;
+    if (in.fail())
+    {
+      printf("  %s is truncated after %ld entries\n", file, (long)e);
+      exit(1);
+    }
+    if (i < 1 || i > A.N || j < 1 || j > A.M)
+    {
+      printf("  Entry %ld ( %d, %d ) of %s is outside the %d x %d matrix\n", (long)e + 1, i, j, file, A.N, A.M);
+      exit(1);
+    }
+    rows.push_back(i - 1);
+    cols.push_back(j - 1);
+    vals.push_back(v);
+    if (symmetric && i != j)
+    {
+      rows.push_back(j - 1);
+      cols.push_back(i - 1);
+      vals.push_back(mirror * v);
+    }
+  }
+
+  // Counting sort of the entries by row.
+  A.row_ptr.assign(A.N + 1, 0);
+  for (size_t e = 0; e < rows.size(); e++)
+  {
+    A.row_ptr[rows[e] + 1]++;
+  }
+  for (int i = 0; i < A.N; i++)
+  {
+    A.row_ptr[i + 1] += A.row_ptr[i];
+  }
+  A.col.resize(rows.size());
+  A.val.resize(rows.size());
+  vector<int> next(A.row_ptr.begin(), A.row_ptr.end() - 1);
+  for (size_t e = 0; e < rows.size(); e++)
+  {
+    int k = next[rows[e]]++;
+    A.col[k] = cols[e];
+    A.val[k] = vals[e];
+  }
+}
+
+// Irregular matrix of ones: row lengths vary between 1 and 2 * nnz_row - 1,
+// and one row in 64 holds 16 times more non zeros. Columns are uniformly
+// random so x is gathered without locality.
+void generate_csr(int N, int M, int nnz_row, csr_matrix &A)
+{
+  A.N = N;
+  A.M = M;
+  A.row_ptr.assign(N + 1, 0);
+
+  uint64_t seed = 88172645463325252ull;
+  auto next = [&seed]() {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+  };
+
+  for (int i = 0; i < N; i++)
+  {
+    int len = 1 + next() % (2 * nnz_row - 1);
+    if (i % 64 == 0)
+      len = 16 * nnz_row;
+    A.row_ptr[i + 1] = A.row_ptr[i] + min(len, M);
+  }
+  A.col.resize(A.row_ptr[N]);
+  A.val.assign(A.row_ptr[N], 1);
+  for (int i = 0; i < N; i++)
+  {
+    for (int k = A.row_ptr[i]; k < A.row_ptr[i + 1]; k++)
+    {
+      A.col[k] = next() % M;
+    }
+    sort(A.col.begin() + A.row_ptr[i], A.col.begin() + A.row_ptr[i + 1]);
+  }
+}
+
+void csr_to_sell(const csr_matrix &A, int C, int sigma, sell_matrix &S)
+{
+  S.N = A.N;
+  S.M = A.M;
+  S.C = C;
+  S.sigma = sigma;
+  S.nchunks = (A.N + C - 1) / C;
+
+  // Sort the rows by decreasing length inside each window of sigma rows.
+  S.perm.assign(S.nchunks * C, -1);
+  for (int i = 0; i < A.N; i++)
+  {
+    S.perm[i] = i;
+  }
+  auto length = [&A](int i) { return A.row_ptr[i + 1] - A.row_ptr[i]; };
+  for (int w = 0; w < A.N; w += sigma)
+  {
+    int last = min(w + sigma, A.N);
+    stable_sort(S.perm.begin() + w, S.perm.begin() + last,
+                [&length](int a, int b) { return length(a) > length(b); });
+  }
+
+  S.chunk_ptr.assign(S.nchunks + 1, 0);
+  S.chunk_len.assign(S.nchunks, 0);
+  for (int c = 0; c < S.nchunks; c++)
+  {
+    int len = 0;
+    for (int r = 0; r < C; r++)
+    {
+      int i = S.perm[c * C + r];
+      if (i >= 0)
+        len = max(len, length(i));
+    }
+    S.chunk_len[c] = len;
+    S.chunk_ptr[c + 1] = S.chunk_ptr[c] + len * C;
+  }
+
+  // Padding slots multiply 0 by x[0].
+  S.col.assign(S.chunk_ptr[S.nchunks], 0);
+  S.val.assign(S.chunk_ptr[S.nchunks], 0);
+  #pragma omp parallel for schedule(static)
+  for (int c = 0; c < S.nchunks; c++)
+  {
+    for (int r = 0; r < C; r++)
+    {
+      int i = S.perm[c * C + r];
+      if (i < 0)
+        continue;
+      for (int k = 0; k < length(i); k++)
+      {
+        S.col[S.chunk_ptr[c] + k * C + r] = A.col[A.row_ptr[i] + k];
+        S.val[S.chunk_ptr[c] + k * C + r] = A.val[A.row_ptr[i] + k];
+      }
+    }
+  }
+}
+
+// bounds[t] is the first unit of thread t, taken where the prefix sum of the
+// work crosses t / parts of the total.
+void partition(const vector<int64_t> &prefix, int parts, vector<int> &bounds)
+{
+  int units = prefix.size() - 1;
+  int64_t total = prefix[units];
+  bounds.assign(parts + 1, units);
+  bounds[0] = 0;
+  for (int t = 1; t < parts; t++)
+  {
+    int64_t target = total * t / parts;
+    bounds[t] = lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+  }
+}
+
+double multiplyCSR(const csr_matrix &A, const double *x, const double *y, const vector<int> &bounds)
+{
+  const int *row_ptr = A.row_ptr.data();
+  const int *col = A.col.data();
+  const double *val = A.val.data();
+  const int parts = bounds.size() - 1;
+  double result = 0;
+
+  // One part per thread, the loop only matters if the runtime gives fewer threads
+
+  #pragma omp parallel num_threads(parts) reduction(+ : result)
+  for (int t = omp_get_thread_num(); t < parts; t += omp_get_num_threads())
+  {
+    for (int i = bounds[t]; i < bounds[t + 1]; i++)
+    {
+      double sum = 0;
+      #pragma omp simd reduction(+ : sum)
+      for (int k = row_ptr[i]; k < row_ptr[i + 1]; k++)
+      {
+        sum += val[k] * x[col[k]];
+      }
+      result += sum * y[i];
+    }
+  }
+  return result;
+}
+
+double multiplySELL(const sell_matrix &S, const double *x, const double *y, const vector<int> &bounds)
+{
+  const int C = S.C;
+  const int *col = S.col.data();
+  const double *val = S.val.data();
+  const int parts = bounds.size() - 1;
+  double result = 0;
+
+  #pragma omp parallel num_threads(parts) reduction(+ : result)
+  for (int t = omp_get_thread_num(); t < parts; t += omp_get_num_threads())
+  {
+    for (int c = bounds[t]; c < bounds[t + 1]; c++)
+    {
+      // One accumulator per row of the chunk, the C rows advance together.
+      double sum[MAX_C] = {0};
+      const int *cc = col + S.chunk_ptr[c];
+      const double *vc = val + S.chunk_ptr[c];
+      for (int k = 0; k < S.chunk_len[c]; k++)
+      {
+        #pragma omp simd
+        for (int r = 0; r < C; r++)
+        {
+          sum[r] += vc[k * C + r] * x[cc[k * C + r]];
+        }
+      }
+      for (int r = 0; r < C; r++)
+      {
+        int i = S.perm[c * C + r];
+        if (i >= 0)
+          result += sum[r] * y[i];
+      }
+    }
+  }
+  return result;
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << name
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
@@ -0,0 +1,371 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include "../huge_alloc.hpp"
+
+using namespace std;
+void checkSizes(int &N, int &M, int &S, int &nrepeat);
+double multiplyVectors(double *a, double *b, int sizea, int sizeb);
+void chooseGrid(int N, int M, int T, int &pr, int &pc);
+void write_perf_csv(int pr, int pc, int nb_threads, int n, int m, int repeat, double runtime);
+
+// Partial sum of one thread, on its own cache line
+struct alignas(64) partial_sum
+{
+  double value;
+};
+
+int main(int argc, char *argv[])
+{
+  int N = 4096;        // number of rows 2^12
+  int M = 1024;        // number of columns 2^10
+  int S = 4096 * 1024; // total size 2^22
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+  int pr = 0, pc = 0;  // thread grid, rows x columns, 0 to choose from the shape
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = pow(2, atoi(argv[++i]));
+      printf("  User N is %d\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = pow(2, atof(argv[++i]));
+      printf("  User M is %d\n", M);
+    }
+    else if ((strcmp(argv[i], "-S") == 0) || (strcmp(argv[i], "-Size") == 0))
+    {
+      S = pow(2, atof(argv[++i]));
+      printf("  User S is %d\n", S);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if ((strcmp(argv[i], "-G") == 0) || (strcmp(argv[i], "-grid") == 0))
+    {
+      if (sscanf(argv[++i], "%dx%d", &pr, &pc) != 2 || pr < 1 || pc < 1)
+      {
+        printf("  Grid must be given as <rows>x<columns>\n");
+        exit(1);
+      }
+      printf("  User grid is %dx%d\n", pr, pc);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x Options:\n");
+      printf("  -Rows (-N) <int>:      exponent num, determines number of rows 2^num (default: 2^12 = 4096)\n");
+      printf("  -Columns (-M) <int>:   exponent num, determines number of columns 2^num (default: 2^10 = 1024)\n");
+      printf("  -Size (-S) <int>:      exponent num, determines total matrix size 2^num (default: 2^22 = 4096*1024 )\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -grid (-G) <r>x<c>:    r thread rows times c thread columns (default: chosen from N, M and the threads)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  S = N * M;
+  // Check sizes.
+  checkSizes(N, M, S, nrepeat);
+
+  // Allocate x,y,A
+  double *y = new double[N];
+  double *x = new double[M];
+  double **A = new double *[N];
+
+  // A is one block so its pages can be chosen, the rows point into it.
+  double *A_data = (double *)huge_alloc((size_t)N * M * sizeof(double));
+
+  for (int i = 0; i < N; i++)
+  {
+    A[i] = A_data + (size_t)i * M;
+  }
+
+  // Initialize y vector to 1.
+  for (int i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (int i = 0; i < M; i++)
+  {
+    x[i] = 1;
+  }
+
+  // Initialize A matrix, you can use a 1D index if you want a flat structure (i.e. a 1D array) e.g. j*M+i is the same than [j][i]
+  for (int i = 0; i < N; i++)
+  {
+    for (int j = 0; j < M; j++)
+    {
+      A[i][j] = 1;
+    }
+  }
+
+  // Each thread owns a block of rows and columns of A
+  int T = omp_get_max_threads();
+  if (pr == 0)
+    chooseGrid(N, M, T, pr, pc);
+  T = pr * pc;
+  printf("  Thread grid %d x %d, blocks of %d rows x %d columns\n", pr, pc, (N + pr - 1) / pr, (M + pc - 1) / pc);
+  partial_sum *partials = new partial_sum[T];
+
+  print_pages("A");
+
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    // For each line i
+    // Multiply the i lines with the vector x
+    // Sum the results of the previous step into a single variable
+    // Multiply the result of the previous step with the i value of vector y
+    // Sum the results of the previous step into a single variable (result)
+    double result = 0;
+
+    #pragma omp parallel num_threads(T)
+    {
+      // Blocks are dealt round robin in case the runtime gives fewer threads
+      for (int b = omp_get_thread_num(); b < T; b += omp_get_num_threads())
+      {
+        int r = b / pc, c = b % pc;
+        int i0 = (long)N * r / pr, i1 = (long)N * (r + 1) / pr;
+        int j0 = (long)M * c / pc, j1 = (long)M * (c + 1) / pc;
+        double sum = 0;
+        for (int i = i0; i < i1; i++)
+        {
+          sum += multiplyVectors(A[i] + j0, x + j0, j1 - j0, j1 - j0) * y[i];
+        }
+        partials[b].value = sum;
+      }
+      #pragma omp barrier
+
+      // Tree combine, log2(T) steps, each ends with the barrier of the omp for
+      for (int stride = 1; stride < T; stride *= 2)
+      {
+        #pragma omp for schedule(static)
+        for (int b = 0; b < T; b += 2 * stride)
+        {
+          if (b + stride < T)
+            partials[b].value += partials[b + stride].value;
+        }
+      }
+    }
+    result = partials[0].value;
+
+    // Output result.
+    if (repeat == (nrepeat - 1))
+    {
+      printf("  Computed result for %d x %d is %lf\n", N, M, result);
+    }
+
+    const double solution = (double)N * (double)M;
+
+    if (result != solution)
+    {
+      printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+    }
+  }
+
+  gettimeofday(&end, NULL);
+  long long tlb_misses = tlb.stop();
+
+  // Calculate time.
+  // double time = timer.seconds();
+  double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  // double Gbytes = 1.0e-9 * double( sizeof(double) * ( 2 * M * N + N ) );
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (M + M * N + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %d ) M( %d ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  write_perf_csv(pr, pc, nb_thread, N, M, nrepeat, time);
+  write_pages_csv("2_8 2D " + to_string(pr) + "x" + to_string(pc), nb_thread, N, M, nrepeat, time, tlb_misses);
+  delete[] partials;
+  huge_free(A_data, (size_t)N * M * sizeof(double));
+  delete[] A;
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+void checkSizes(int &N, int &M, int &S, int &nrepeat)
+{
+  // If S is undefined and N or M is undefined, set S to 2^22 or the bigger of N and M.
+  if (S == -1 && (N == -1 || M == -1))
+  {
+    S = pow(2, 22);
+    if (S < N)
+      S = N;
+    if (S < M)
+      S = M;
+  }
+
+  // If S is undefined and both N and M are defined, set S = N * M.
+  if (S == -1)
+    S = N * M;
+
+  // If both N and M are undefined, fix row length to the smaller of S and 2^10 = 1024.
+  if (N == -1 && M == -1)
+  {
+    if (S > 1024)
+    {
+      M = 1024;
+    }
+    else
+    {
+      M = S;
+    }
+  }
+
+  // If only M is undefined, set it.
+  if (M == -1)
+    M = S / N;
+
+  // If N is undefined, set it.
+  if (N == -1)
+    N = S / M;
+
+  printf("  Total size S = %d N = %d M = %d\n", S, N, M);
+
+  // Check sizes.
+  if ((S < 0) || (N < 0) || (M < 0) || (nrepeat < 0))
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+
+  if ((N * M) != S)
+  {
+    printf("  N * M != S\n");
+    exit(1);
+  }
+}
+
+double multiplyVectors(double *a, double *b, int sizea, int sizeb)
+{
+
+  assert(sizea == sizeb);
+  double sum = 0;
+  #pragma omp simd
+  for (int i = 0; i < sizea; i++)
+  {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+// Splitting rows needs no combine, so every thread gets rows while there are
+// enough. Otherwise the row split is the largest divisor of T not above N
+// and the remaining factor splits the columns, as long as a column block
+// keeps at least 64 doubles (a few cache lines, enough for the simd loop).
+void chooseGrid(int N, int M, int T, int &pr, int &pc)
+{
+  pr = 1;
+  for (int d = 1; d <= T; d++)
+  {
+    if (T % d == 0 && d <= N)
+      pr = d;
+  }
+  pc = T / pr;
+  while (pc > 1 && M / pc < 64)
+    pc--;
+}
+
+void write_perf_csv(int pr, int pc, int nb_threads, int n, int m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << "2_8 2D " << pr << "x" << pc << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
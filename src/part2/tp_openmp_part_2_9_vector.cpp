@@ -0,0 +1,323 @@
+/*
+//@HEADER
+// ************************************************************************
+//
+//                        Kokkos v. 2.0
+//              Copyright (2014) Sandia Corporation
+//
+// Under the terms of Contract DE-AC04-94AL85000 with Sandia Corporation,
+// the U.S. Government retains certain rights in this software.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the Corporation nor the names of the
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY SANDIA CORPORATION "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SANDIA CORPORATION OR THE
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Questions Contact  H. Carter Edwards (hcedwar@sandia.gov)
+//
+// ************************************************************************
+//@HEADER
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <assert.h>
+#include <cmath>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdint>
+#include <cerrno>
+#ifdef __AVX512F__
+#include <immintrin.h>
+#endif
+#include "../huge_alloc.hpp"
+
+using namespace std;
+size_t parseSize(const char *arg);
+double multiplyVectors(const double *a, const double *b, size_t size);
+void write_perf_csv(int nb_threads, size_t n, size_t m, int repeat, double runtime);
+
+int main(int argc, char *argv[])
+{
+  size_t N = 4096;     // number of rows 2^12
+  size_t M = 1024;     // number of columns 2^10
+  int nrepeat = 100;   // number of repeats of the test
+  int nb_thread = 2;
+
+  // Read command line arguments.
+  for (int i = 0; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-Rows") == 0))
+    {
+      N = parseSize(argv[++i]);
+      printf("  User N is %zu\n", N);
+    }
+    else if ((strcmp(argv[i], "-M") == 0) || (strcmp(argv[i], "-Columns") == 0))
+    {
+      M = parseSize(argv[++i]);
+      printf("  User M is %zu\n", M);
+    }
+    else if (strcmp(argv[i], "-nrepeat") == 0)
+    {
+      nrepeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-T") == 0))
+    {
+      nb_thread = atol(argv[++i]);
+      omp_set_num_threads(nb_thread);
+      printf("  Nb_thread is %d\n", nb_thread);
+    }
+    else if (strcmp(argv[i], "-pages") == 0)
+    {
+      huge_pages.mode = parse_page_mode(argv[++i]);
+      printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+    }
+    else if (strcmp(argv[i], "-interleave") == 0)
+    {
+      huge_pages.interleave = true;
+      printf("  A is interleaved over the NUMA nodes\n");
+    }
+    else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+    {
+      printf("  y^T*A*x Options:\n");
+      printf("  -Rows (-N) <size>:     number of rows (default: 4096)\n");
+      printf("  -Columns (-M) <size>:  number of columns (default: 1024)\n");
+      printf("                         a size is a count (1000), a count with a k, m or g suffix (3k = 3000)\n");
+      printf("                         or a power of two (2^12)\n");
+      printf("  -nrepeat <int>:        number of repetitions (default: 100)\n");
+      printf("  -pages <name>:         pages of A, default, thp, 2m or 1g (default: default)\n");
+      printf("  -interleave:           interleave A over the NUMA nodes\n");
+      printf("  -help (-h):            print this message\n\n");
+      exit(1);
+    }
+  }
+  // Check sizes.
+  if (N == 0 || M == 0 || nrepeat < 0)
+  {
+    printf("  Sizes must be greater than 0.\n");
+    exit(1);
+  }
+  size_t S = N * M;
+  if (S / N != M)
+  {
+    printf("  N * M overflows\n");
+    exit(1);
+  }
+  printf("  Total size S = %zu N = %zu M = %zu ( %g GB )\n", S, N, M, 1.0e-9 * sizeof(double) * S);
+
+  // Allocate x,y,A
+  double *y = new double[N];
+  double *x = new double[M];
+  double **A = new double *[N];
+  // A is one block so its pages can be chosen, the rows point into it.
+  double *A_data = (double *)huge_alloc(S * sizeof(double));
+
+  // Initialize y vector to 1.
+  for (size_t i = 0; i < N; i++)
+  {
+    y[i] = 1;
+  }
+
+  // Initialize x vector to 1.
+  for (size_t j = 0; j < M; j++)
+  {
+    x[j] = 1;
+  }
+
+  // Allocate and initialize A matrix, in parallel with the same static
+  // schedule as the kernel so the pages are touched first by the thread
+  // reading them (matters for matrices of several tens of GB).
+  #pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < N; i++)
+  {
+    A[i] = A_data + i * M;
+    for (size_t j = 0; j < M; j++)
+    {
+      A[i][j] = 1;
+    }
+  }
+
+  print_pages("A");
+
+  // Timer products.
+  struct timeval begin, end;
+  tlb_counter tlb;
+
+  tlb.start();
+  gettimeofday(&begin, NULL);
+
+  for (int repeat = 0; repeat < nrepeat; repeat++)
+  {
+    // For each line i
+    // Multiply the i lines with the vector x
+    // Sum the results of the previous step into a single variable
+    // Multiply the result of the previous step with the i value of vector y
+    // Sum the results of the previous step into a single variable (result)
+    double result = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+ : result)
+    for (size_t i = 0; i < N; i++)
+    {
+
+      result = result + multiplyVectors(A[i], x, M) * y[i];
+    }
+    // Output result.
+    if (repeat == (nrepeat - 1))
+    {
+      printf("  Computed result for %zu x %zu is %lf\n", N, M, result);
+    }
+
+    const double solution = (double)N * (double)M;
+
+    if (result != solution)
+    {
+      printf("  Error: result( %lf ) != solution( %lf )\n", result, solution);
+    }
+  }
+
+  gettimeofday(&end, NULL);
+  long long tlb_misses = tlb.stop();
+
+  // Calculate time.
+  // double time = timer.seconds();
+  double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+  // Calculate bandwidth.
+  // Each matrix A row (each of length M) is read once.
+  // The x vector (of length M) is read N times.
+  // The y vector (of length N) is read once.
+  // double Gbytes = 1.0e-9 * double( sizeof(double) * ( 2 * M * N + N ) );
+  double Gbytes = 1.0e-9 * double(sizeof(double) * (M + M * N + N));
+
+  // Print results (problem size, time and bandwidth in GB/s).
+  printf("  N( %zu ) M( %zu ) nrepeat ( %d ) problem( %g MB ) time( %g s ) bandwidth( %g GB/s )\n",
+         N, M, nrepeat, Gbytes * 1000, time, Gbytes * nrepeat / time);
+  print_tlb_misses(tlb_misses, nrepeat);
+
+  write_perf_csv(nb_thread, N, M, nrepeat, time);
+  write_pages_csv("2_9 size_t any shape", nb_thread, N, M, nrepeat, time, tlb_misses);
+  huge_free(A_data, S * sizeof(double));
+  delete[] A;
+  delete[] y;
+  delete[] x;
+
+  return 0;
+}
+
+// Reads a dimension: 1000, 3k, 2m, 1g (powers of ten) or 2^20
+size_t parseSize(const char *arg)
+{
+  char *end;
+  if (strncmp(arg, "2^", 2) == 0)
+  {
+    unsigned long e = strtoul(arg + 2, &end, 10);
+    if (*end != '\0' || e > 62)
+    {
+      printf("  Invalid size %s\n", arg);
+      exit(1);
+    }
+    return (size_t)1 << e;
+  }
+  errno = 0;
+  size_t v = strtoull(arg, &end, 10);
+  size_t scale = 1;
+  if (*end == 'k' || *end == 'K')
+    scale = 1000, end++;
+  else if (*end == 'm' || *end == 'M')
+    scale = 1000000, end++;
+  else if (*end == 'g' || *end == 'G')
+    scale = 1000000000, end++;
+  if (*end != '\0' || end == arg)
+  {
+    printf("  Invalid size %s\n", arg);
+    exit(1);
+  }
+  if (errno == ERANGE || v > SIZE_MAX / scale)
+  {
+    printf("  Size %s overflows\n", arg);
+    exit(1);
+  }
+  return v * scale;
+}
+
+// Dot product of any length. The body runs on full vectors with
+// independent accumulators, the last size % 8 elements are one masked
+// AVX-512 operation, or a short simd loop without AVX-512.
+double multiplyVectors(const double *a, const double *b, size_t size)
+{
+  size_t body = size - size % 8;
+  double sum = 0;
+
+#ifdef __AVX512F__
+  __m512d acc0 = _mm512_setzero_pd();
+  __m512d acc1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= body; i += 16)
+  {
+    acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), acc0);
+    acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), acc1);
+  }
+  if (i < body)
+  {
+    acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), acc0);
+  }
+  if (body < size)
+  {
+    __mmask8 tail = (__mmask8)((1u << (size - body)) - 1);
+    acc1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(tail, a + body), _mm512_maskz_loadu_pd(tail, b + body), acc1);
+  }
+  sum = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+#else
+  #pragma omp simd reduction(+ : sum)
+  for (size_t i = 0; i < body; i++)
+  {
+    sum += a[i] * b[i];
+  }
+  #pragma omp simd reduction(+ : sum)
+  for (size_t i = body; i < size; i++)
+  {
+    sum += a[i] * b[i];
+  }
+#endif
+
+  return sum;
+}
+
+void write_perf_csv(int nb_threads, size_t n, size_t m, int repeat, double runtime)
+{
+  ofstream myfile;
+  myfile.open("stats_part2.csv", ios_base::app);
+  myfile.precision(8);
+  myfile << "2_9 size_t any shape" << huge_suffix()
+         << "," << nb_threads << "," << n << "," << m << "," << repeat << "," << runtime << "\n";
+
+  myfile.close();
+}
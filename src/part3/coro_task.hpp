@@ -0,0 +1,266 @@
+/*
+**  C++20 coroutine tasks executed by the work stealing workers of
+**  work_stealing.hpp, third backend of the part 3 benchmarks (needs -std=c++20).
+**
+**  A task<T> is lazy: co_await runs it inline on the current worker by
+**  symmetric transfer and resumes the awaiter the same way when it ends.
+**  fork() makes it stealable instead, a later co_await joins it:
+**
+**     coro::task<int> fib(int n)
+**     {
+**        coro::task<int> left = coro::fork(fib(n - 1));
+**        int b = co_await fib(n - 2);
+**        int a = co_await left;
+**        co_return a + b;
+**     }
+**
+**  A worker whose coroutine waits for a stolen child returns to the
+**  scheduler loop, nothing blocks and no stack is kept for the waiting frame.
+*/
+
+#ifndef TP_OPENMP_CORO_TASK_HPP
+#define TP_OPENMP_CORO_TASK_HPP
+
+#include <coroutine>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "work_stealing.hpp"
+#include "task_memory.hpp"
+
+namespace coro
+{
+
+// Coroutine frames allocated since the start, to compare with OpenMP task
+// descriptors, only counted with taskmem::counting
+inline std::atomic<uint64_t> frames(0);
+inline std::atomic<uint64_t> frame_bytes(0);
+// Frames come from the taskmem slabs instead of the global allocator,
+// must not change while coroutines are alive
+inline bool use_pool = false;
+
+// Continuation slot states, any other value is the awaiting coroutine address
+static void *const NOT_AWAITED = nullptr;
+static void *const COMPLETED = (void *)1;
+
+struct promise_base
+{
+   std::atomic<void *> continuation{NOT_AWAITED};
+   // Used to push the coroutine on the worker deque when forked
+   ws::job resume_job;
+   bool forked = false;
+
+   static void *operator new(size_t size)
+   {
+      if (taskmem::counting)
+      {
+         frames.fetch_add(1, std::memory_order_relaxed);
+         frame_bytes.fetch_add(size, std::memory_order_relaxed);
+      }
+      if (use_pool)
+         return taskmem::allocate(size);
+      taskmem::account(size);
+      return ::operator new(size);
+   }
+
+   static void operator delete(void *p, size_t size)
+   {
+      if (use_pool)
+      {
+         taskmem::release(p, size);
+         return;
+      }
+      taskmem::account(-(int64_t)size);
+      ::operator delete(p, size);
+   }
+
+   std::suspend_always initial_suspend() noexcept
+   {
+      return {};
+   }
+
+   struct final_awaiter
+   {
+      bool await_ready() noexcept
+      {
+         return false;
+      }
+
+      template <typename P>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+      {
+         void *waiter = h.promise().continuation.exchange(COMPLETED, std::memory_order_acq_rel);
+         if (waiter == NOT_AWAITED)
+            return std::noop_coroutine();
+         return std::coroutine_handle<>::from_address(waiter);
+      }
+
+      void await_resume() noexcept
+      {
+      }
+   };
+
+   final_awaiter final_suspend() noexcept
+   {
+      return {};
+   }
+
+   void unhandled_exception()
+   {
+      std::terminate();
+   }
+};
+
+template <typename T>
+class task;
+
+template <typename T>
+struct promise : promise_base
+{
+   T value;
+
+   task<T> get_return_object();
+
+   void return_value(T v)
+   {
+      value = v;
+   }
+
+   T result()
+   {
+      return value;
+   }
+};
+
+template <>
+struct promise<void> : promise_base
+{
+   task<void> get_return_object();
+
+   void return_void()
+   {
+   }
+
+   void result()
+   {
+   }
+};
+
+template <typename T>
+class task
+{
+ public:
+   typedef coro::promise<T> promise_type;
+   typedef std::coroutine_handle<promise_type> handle_type;
+
+   explicit task(handle_type h) : handle(h)
+   {
+   }
+
+   task(task &&other) : handle(std::exchange(other.handle, nullptr))
+   {
+   }
+
+   task(const task &) = delete;
+   task &operator=(const task &) = delete;
+
+   ~task()
+   {
+      if (handle)
+         handle.destroy();
+   }
+
+   // Makes the task stealable by the other workers
+   void start_async()
+   {
+      promise_type &p = handle.promise();
+      p.forked = true;
+      p.resume_job.run = [](ws::job *j) {
+         promise_base *base = (promise_base *)((char *)j - offsetof(promise_base, resume_job));
+         handle_type::from_promise(*static_cast<promise_type *>(base)).resume();
+      };
+      ws::enqueue(&p.resume_job);
+   }
+
+   bool done() const
+   {
+      return handle.promise().continuation.load(std::memory_order_acquire) == COMPLETED;
+   }
+
+   T result()
+   {
+      return handle.promise().result();
+   }
+
+   struct awaiter
+   {
+      handle_type handle;
+
+      bool await_ready()
+      {
+         return false;
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter)
+      {
+         promise_type &p = handle.promise();
+         if (!p.forked)
+         {
+            // Not started yet, run it right now on this worker
+            p.continuation.store(waiter.address(), std::memory_order_relaxed);
+            return handle;
+         }
+         void *expected = NOT_AWAITED;
+         if (p.continuation.compare_exchange_strong(expected, waiter.address(), std::memory_order_acq_rel))
+            return std::noop_coroutine(); // resumed by the final_awaiter of the child
+         return waiter;                   // already completed
+      }
+
+      T await_resume()
+      {
+         return handle.promise().result();
+      }
+   };
+
+   awaiter operator co_await()
+   {
+      return awaiter{handle};
+   }
+
+ private:
+   handle_type handle;
+};
+
+template <typename T>
+task<T> promise<T>::get_return_object()
+{
+   return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object()
+{
+   return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+template <typename T>
+task<T> fork(task<T> t)
+{
+   t.start_async();
+   return t;
+}
+
+// Runs t from a non coroutine context on the current worker, helping the
+// other workers until it completes
+template <typename T>
+T sync_wait(task<T> &t)
+{
+   t.start_async();
+   ws::frame::help_while([&t] { return !t.done(); });
+   return t.result();
+}
+
+} // namespace coro
+
+#endif
@@ -0,0 +1,119 @@
+/*
+**  Task frame memory for the custom part 3 backends: a per-thread slab
+**  allocator and the accounting used to size memory for wide task trees.
+**
+**  Blocks are rounded up to SLAB_CLASS bytes and served from per-thread
+**  free lists refilled from SLAB_CHUNK chunks, so an allocation is a
+**  thread-local pop without any lock. A block freed by another thread goes
+**  to that thread's list; chunks are never given back to the system.
+*/
+
+#ifndef TP_OPENMP_TASK_MEMORY_HPP
+#define TP_OPENMP_TASK_MEMORY_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <sys/resource.h>
+
+namespace taskmem
+{
+
+#ifndef SLAB_CLASS
+#define SLAB_CLASS 64
+#endif
+// Bigger blocks go to the global allocator
+#ifndef SLAB_CLASSES
+#define SLAB_CLASSES 16
+#endif
+#ifndef SLAB_CHUNK
+#define SLAB_CHUNK (64 * 1024)
+#endif
+
+struct free_block
+{
+   free_block *next;
+};
+
+// Trivially destructible on purpose, blocks may outlive their thread
+struct thread_pool
+{
+   free_block *free[SLAB_CLASSES];
+   char *bump;
+   size_t left;
+};
+
+inline thread_local thread_pool pool = {};
+
+// Shared counters of the task frames (here and in coro_task.hpp), off by
+// default: every frame would pay for atomics inside the timed region
+inline bool counting = false;
+
+// Bytes currently allocated for task frames and the maximum reached
+inline std::atomic<int64_t> live_bytes(0);
+inline std::atomic<int64_t> peak_bytes(0);
+
+inline void account(int64_t delta)
+{
+   if (!counting)
+      return;
+   int64_t live = live_bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+   int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+   while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+      ;
+}
+
+inline void *allocate(size_t size)
+{
+   account(size);
+   if (size == 0 || size > SLAB_CLASS * SLAB_CLASSES)
+      return ::operator new(size);
+
+   size_t cls = (size - 1) / SLAB_CLASS;
+   free_block *b = pool.free[cls];
+   if (b != nullptr)
+   {
+      pool.free[cls] = b->next;
+      return b;
+   }
+   size_t rounded = (cls + 1) * SLAB_CLASS;
+   if (pool.left < rounded)
+   {
+      // The tail of the previous chunk is dropped
+      pool.bump = (char *)aligned_alloc(SLAB_CLASS, SLAB_CHUNK);
+      if (pool.bump == nullptr)
+         throw std::bad_alloc();
+      pool.left = SLAB_CHUNK;
+   }
+   void *p = pool.bump;
+   pool.bump += rounded;
+   pool.left -= rounded;
+   return p;
+}
+
+inline void release(void *p, size_t size)
+{
+   account(-(int64_t)size);
+   if (size == 0 || size > SLAB_CLASS * SLAB_CLASSES)
+   {
+      ::operator delete(p);
+      return;
+   }
+   size_t cls = (size - 1) / SLAB_CLASS;
+   free_block *b = (free_block *)p;
+   b->next = pool.free[cls];
+   pool.free[cls] = b;
+}
+
+// Peak resident set size of the process in KB
+inline long peak_rss_kb()
+{
+   struct rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   return usage.ru_maxrss;
+}
+
+} // namespace taskmem
+
+#endif
@@ -0,0 +1,491 @@
+/*
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <iostream>
+#include <omp.h>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static int N = 5;
+int num_threads = 1;
+#ifndef FS
+#define FS 38
+#endif
+
+// Below this number of limbs the big number product is done with the schoolbook method
+#define KARATSUBA_CUTOFF 48
+// Karatsuba levels deeper than this one are not spawned as tasks anymore
+#define KARATSUBA_TASK_DEPTH 4
+
+// Available engines, selected with -E
+enum engine
+{
+   ENGINE_U64,
+   ENGINE_U64_MATRIX,
+   ENGINE_U128,
+   ENGINE_U128_MATRIX,
+   ENGINE_BIG
+};
+
+static const char *engine_names[] = {"u64", "u64-matrix", "u128", "u128-matrix", "big"};
+
+// Biggest index whose fibonacci number fits in the result type
+#define FIB_MAX_U64 93
+#define FIB_MAX_U128 186
+
+typedef unsigned __int128 uint128_t;
+
+// Arbitrary precision unsigned integer, 32 bits limbs, least significant limb first.
+// Zero is the empty vector.
+typedef vector<uint32_t> bignum;
+
+struct node
+{
+   int data;
+   bignum fibdata;
+   struct node *next;
+};
+
+void write_perf_csv(int nb_threads, int n, int e, double runtime)
+{
+   ofstream myfile;
+   myfile.open("stats_part3.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << "3_3 fast doubling " << engine_names[e]
+          << "," << nb_threads << "," << n << "," << runtime << "\n";
+
+   myfile.close();
+}
+
+/* ---------------------------------------------------------------------- */
+/* Fixed width engines                                                     */
+/* ---------------------------------------------------------------------- */
+
+// F(2k) = F(k) * (2F(k+1) - F(k))
+// F(2k+1) = F(k)^2 + F(k+1)^2
+template <typename T>
+T fib_doubling(int n)
+{
+   T a = 0, b = 1;
+   for (int bit = 31 - __builtin_clz(n | 1); bit >= 0; bit--)
+   {
+      T c = a * (2 * b - a);
+      T d = a * a + b * b;
+      if ((n >> bit) & 1)
+      {
+         a = d;
+         b = c + d;
+      }
+      else
+      {
+         a = c;
+         b = d;
+      }
+   }
+   return a;
+}
+
+// [[F(n+1), F(n)], [F(n), F(n-1)]] = [[1, 1], [1, 0]]^n
+template <typename T>
+T fib_matrix(int n)
+{
+   T r00 = 1, r01 = 0, r11 = 1;
+   T m00 = 1, m01 = 1, m11 = 0;
+   while (n > 0)
+   {
+      if (n & 1)
+      {
+         T t00 = r00 * m00 + r01 * m01;
+         T t01 = r00 * m01 + r01 * m11;
+         T t11 = r01 * m01 + r11 * m11;
+         r00 = t00;
+         r01 = t01;
+         r11 = t11;
+      }
+      n >>= 1;
+      if (n > 0)
+      {
+         T t00 = m00 * m00 + m01 * m01;
+         T t01 = m00 * m01 + m01 * m11;
+         T t11 = m01 * m01 + m11 * m11;
+         m00 = t00;
+         m01 = t01;
+         m11 = t11;
+      }
+   }
+   return r01;
+}
+
+bignum from_u128(uint128_t v)
+{
+   bignum r;
+   while (v != 0)
+   {
+      r.push_back((uint32_t)v);
+      v >>= 32;
+   }
+   return r;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Big number engine                                                      */
+/* ---------------------------------------------------------------------- */
+
+void trim(bignum &a)
+{
+   while (!a.empty() && a.back() == 0)
+      a.pop_back();
+}
+
+// r += a << (32 * shift), r must be large enough to hold the result
+void add_shifted(bignum &r, const bignum &a, size_t shift)
+{
+   uint64_t carry = 0;
+   size_t i = 0;
+   for (; i < a.size(); i++)
+   {
+      uint64_t t = (uint64_t)r[i + shift] + a[i] + carry;
+      r[i + shift] = (uint32_t)t;
+      carry = t >> 32;
+   }
+   for (i += shift; carry != 0; i++)
+   {
+      uint64_t t = (uint64_t)r[i] + carry;
+      r[i] = (uint32_t)t;
+      carry = t >> 32;
+   }
+}
+
+bignum add(const bignum &a, const bignum &b)
+{
+   const bignum &l = a.size() >= b.size() ? a : b;
+   const bignum &s = a.size() >= b.size() ? b : a;
+   bignum r(l);
+   r.push_back(0);
+   add_shifted(r, s, 0);
+   trim(r);
+   return r;
+}
+
+// a - b, a must be greater or equal to b
+bignum sub(const bignum &a, const bignum &b)
+{
+   bignum r(a);
+   int64_t borrow = 0;
+   for (size_t i = 0; i < r.size(); i++)
+   {
+      int64_t t = (int64_t)r[i] - (i < b.size() ? b[i] : 0) - borrow;
+      borrow = t < 0;
+      r[i] = (uint32_t)(t + (borrow << 32));
+      if (i >= b.size() && borrow == 0)
+         break;
+   }
+   trim(r);
+   return r;
+}
+
+bignum shl1(const bignum &a)
+{
+   bignum r(a.size() + 1);
+   uint32_t carry = 0;
+   for (size_t i = 0; i < a.size(); i++)
+   {
+      r[i] = (a[i] << 1) | carry;
+      carry = a[i] >> 31;
+   }
+   r[a.size()] = carry;
+   trim(r);
+   return r;
+}
+
+bignum mul_schoolbook(const bignum &a, const bignum &b)
+{
+   if (a.empty() || b.empty())
+      return bignum();
+   bignum r(a.size() + b.size(), 0);
+   for (size_t i = 0; i < a.size(); i++)
+   {
+      uint64_t carry = 0;
+      for (size_t j = 0; j < b.size(); j++)
+      {
+         uint64_t t = (uint64_t)a[i] * b[j] + r[i + j] + carry;
+         r[i + j] = (uint32_t)t;
+         carry = t >> 32;
+      }
+      r[i + b.size()] = (uint32_t)carry;
+   }
+   trim(r);
+   return r;
+}
+
+bignum slice(const bignum &a, size_t from, size_t to)
+{
+   from = min(from, a.size());
+   to = min(to, a.size());
+   bignum r(a.begin() + from, a.begin() + to);
+   trim(r);
+   return r;
+}
+
+// Karatsuba product, the three half size products are computed by tasks
+// as long as depth is lower than KARATSUBA_TASK_DEPTH
+bignum mul(const bignum &a, const bignum &b, int depth)
+{
+   if (min(a.size(), b.size()) < KARATSUBA_CUTOFF)
+      return mul_schoolbook(a, b);
+
+   size_t m = max(a.size(), b.size()) / 2;
+   bignum a0 = slice(a, 0, m), a1 = slice(a, m, a.size());
+   bignum b0 = slice(b, 0, m), b1 = slice(b, m, b.size());
+   bignum z0, z1, z2;
+   bool spawn = depth < KARATSUBA_TASK_DEPTH;
+
+   #pragma omp task shared(z0) if (spawn)
+   z0 = mul(a0, b0, depth + 1);
+   #pragma omp task shared(z2) if (spawn)
+   z2 = mul(a1, b1, depth + 1);
+   #pragma omp task shared(z1) if (spawn)
+   z1 = mul(add(a0, a1), add(b0, b1), depth + 1);
+   #pragma omp taskwait
+
+   z1 = sub(sub(z1, z0), z2);
+
+   bignum r(a.size() + b.size() + 1, 0);
+   add_shifted(r, z0, 0);
+   add_shifted(r, z1, m);
+   add_shifted(r, z2, 2 * m);
+   trim(r);
+   return r;
+}
+
+bignum fib_big(int n)
+{
+   bignum a, b(1, 1);
+   for (int bit = 31 - __builtin_clz(n | 1); bit >= 0; bit--)
+   {
+      bignum c, aa, bb;
+      #pragma omp task shared(a, b, c)
+      c = mul(a, sub(shl1(b), a), 1);
+      #pragma omp task shared(a, aa)
+      aa = mul(a, a, 1);
+      #pragma omp task shared(b, bb)
+      bb = mul(b, b, 1);
+      #pragma omp taskwait
+      bignum d = add(aa, bb);
+      if ((n >> bit) & 1)
+      {
+         b = add(c, d);
+         a = d;
+      }
+      else
+      {
+         a = c;
+         b = d;
+      }
+   }
+   return a;
+}
+
+// Decimal conversion is quadratic, only used for small numbers
+string to_decimal(bignum a)
+{
+   if (a.empty())
+      return "0";
+   string s;
+   while (!a.empty())
+   {
+      uint64_t rem = 0;
+      for (size_t i = a.size(); i-- > 0;)
+      {
+         uint64_t cur = (rem << 32) | a[i];
+         a[i] = (uint32_t)(cur / 1000000000);
+         rem = cur % 1000000000;
+      }
+      trim(a);
+      for (int k = 0; k < 9; k++)
+      {
+         s.push_back('0' + rem % 10);
+         rem /= 10;
+         if (a.empty() && rem == 0)
+            break;
+      }
+   }
+   reverse(s.begin(), s.end());
+   return s;
+}
+
+size_t bit_length(const bignum &a)
+{
+   if (a.empty())
+      return 0;
+   return 32 * (a.size() - 1) + (32 - __builtin_clz(a.back()));
+}
+
+/* ---------------------------------------------------------------------- */
+
+void processwork(struct node *p, int e)
+{
+   int n = p->data;
+   switch (e)
+   {
+   case ENGINE_U64:
+      p->fibdata = from_u128(fib_doubling<uint64_t>(n));
+      break;
+   case ENGINE_U64_MATRIX:
+      p->fibdata = from_u128(fib_matrix<uint64_t>(n));
+      break;
+   case ENGINE_U128:
+      p->fibdata = from_u128(fib_doubling<uint128_t>(n));
+      break;
+   case ENGINE_U128_MATRIX:
+      p->fibdata = from_u128(fib_matrix<uint128_t>(n));
+      break;
+   default:
+      p->fibdata = fib_big(n);
+      break;
+   }
+}
+
+struct node *init_list(struct node *p, int first)
+{
+   int i;
+   struct node *head = NULL;
+   struct node *temp = NULL;
+
+   head = new node;
+   p = head;
+   p->data = first;
+   for (i = 0; i < N; i++)
+   {
+      temp = new node;
+      p->next = temp;
+      p = temp;
+      p->data = first + i + 1;
+   }
+   p->next = NULL;
+   return head;
+}
+
+int main(int argc, char *argv[])
+{
+   int first = FS;
+   int e = ENGINE_BIG;
+
+   // Read command line arguments.
+   for (int i = 0; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-num_node") == 0))
+      {
+         N = atoi(argv[++i]);
+         printf("  User num_node is %d\n", N);
+      }
+      else if ((strcmp(argv[i], "-T") == 0))
+      {
+         num_threads = atoi(argv[++i]);
+         printf("  User num_threads is %d\n", num_threads);
+         omp_set_num_threads(num_threads);
+      }
+      else if ((strcmp(argv[i], "-F") == 0) || (strcmp(argv[i], "-first") == 0))
+      {
+         first = atoi(argv[++i]);
+         printf("  User first is %d\n", first);
+      }
+      else if ((strcmp(argv[i], "-E") == 0) || (strcmp(argv[i], "-engine") == 0))
+      {
+         i++;
+         for (e = 0; e <= ENGINE_BIG; e++)
+         {
+            if (strcmp(argv[i], engine_names[e]) == 0)
+               break;
+         }
+         if (e > ENGINE_BIG)
+         {
+            printf("  Unknown engine %s\n", argv[i]);
+            exit(1);
+         }
+         printf("  User engine is %s\n", engine_names[e]);
+      }
+      else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+      {
+         printf("  Fib Options:\n");
+         printf("  -num_node (-N) <int>:  Number of node computing fibonnaci numbers (by default 5)\n");
+         printf("  -first (-F) <int>:     Fibonacci index of the first node (by default %d)\n", FS);
+         printf("  -engine (-E) <name>:   u64, u64-matrix, u128, u128-matrix or big (by default big)\n");
+         printf("  -help (-h):            print this message\n\n");
+         exit(1);
+      }
+   }
+
+   int last = first + N;
+   if ((first < 0) ||
+       ((e == ENGINE_U64 || e == ENGINE_U64_MATRIX) && last > FIB_MAX_U64) ||
+       ((e == ENGINE_U128 || e == ENGINE_U128_MATRIX) && last > FIB_MAX_U128))
+   {
+      printf("  fib(%d) does not fit in engine %s\n", last, engine_names[e]);
+      exit(1);
+   }
+
+   struct node *p = NULL;
+   struct node *temp = NULL;
+   struct node *head = NULL;
+
+   printf("Process linked list\n");
+   printf("  Each linked list node will be processed by function 'processwork()'\n");
+   printf("  Each ll node will compute %d fibonacci numbers beginning with %d\n", N, first);
+
+   p = init_list(p, first);
+   head = p;
+
+   // Timer products.
+   struct timeval begin, end;
+
+   gettimeofday(&begin, NULL);
+   #pragma omp parallel
+   {
+      #pragma omp single
+      {
+         while (p != NULL)
+         {
+            #pragma omp task firstprivate(p)
+            {
+               processwork(p, e);
+            }
+            p = p->next;
+         }
+      }
+   }
+
+   gettimeofday(&end, NULL);
+
+   // Calculate time.
+   double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                 1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+   p = head;
+   while (p != NULL)
+   {
+      if (p->fibdata.size() <= 128)
+         printf("%d : %s\n", p->data, to_decimal(p->fibdata).c_str());
+      else
+         printf("%d : %zu bits, low limb %08x\n", p->data, bit_length(p->fibdata), p->fibdata[0]);
+      temp = p->next;
+      delete p;
+      p = temp;
+   }
+
+   printf("Compute Time: %f seconds\n", time);
+   write_perf_csv(num_threads, N, e, time);
+   return 0;
+}
@@ -0,0 +1,291 @@
+/*
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <iostream>
+#include <omp.h>
+#include <fstream>
+#include <iomanip>
+#include <atomic>
+
+using namespace std;
+
+static int N = 5;
+int num_threads = 1;
+#ifndef FS
+#define FS 38
+#endif
+
+#define CUTOFF 5
+
+// Number of slots of the memo table, must be a power of two
+#ifndef MEMO_SIZE
+#define MEMO_SIZE 1024
+#endif
+// An empty slot, a filled one holds (n + 1) << 32 | fib(n)
+#define MEMO_EMPTY 0
+
+struct node
+{
+   int data;
+   int fibdata;
+   struct node *next;
+};
+
+// Memo table shared by all the tasks of a run, open addressing with linear probing.
+// Key and value are packed in the same 64 bits word so a single CAS publishes both.
+static atomic<uint64_t> memo[MEMO_SIZE];
+static bool use_memo = false;
+// Values below this one are recomputed rather than looked up
+static int memo_min = 20;
+
+// Hit and miss counters, one cache line per thread to keep them out of the measure
+struct memo_counter
+{
+   alignas(64) uint64_t hits;
+   uint64_t misses;
+};
+static memo_counter *counters = NULL;
+
+void write_perf_csv(int nb_threads, int n, double runtime)
+{
+   ofstream myfile;
+   myfile.open("stats_part3.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << (use_memo ? "3_4 shared memo" : "3_4 no memo")
+          << "," << nb_threads << "," << n << "," << runtime << "\n";
+
+   myfile.close();
+}
+
+void write_memo_csv(int nb_threads, int n, double runtime, uint64_t hits, uint64_t misses)
+{
+   ofstream myfile;
+   myfile.open("stats_part3_memo.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << (use_memo ? "3_4 shared memo" : "3_4 no memo")
+          << "," << nb_threads << "," << n << "," << runtime << "," << hits << "," << misses << "\n";
+
+   myfile.close();
+}
+
+static inline uint32_t memo_hash(int n)
+{
+   return ((uint32_t)n * 2654435761u) & (MEMO_SIZE - 1);
+}
+
+bool memo_get(int n, int *res)
+{
+   memo_counter &c = counters[omp_get_thread_num()];
+   uint64_t key = (uint64_t)(n + 1) << 32;
+   for (uint32_t i = memo_hash(n), probe = 0; probe < MEMO_SIZE; i = (i + 1) & (MEMO_SIZE - 1), probe++)
+   {
+      uint64_t slot = memo[i].load(memory_order_acquire);
+      if (slot == MEMO_EMPTY)
+         break;
+      if ((slot & 0xffffffff00000000ull) == key)
+      {
+         *res = (int)(uint32_t)slot;
+         c.hits++;
+         return true;
+      }
+   }
+   c.misses++;
+   return false;
+}
+
+void memo_put(int n, int res)
+{
+   uint64_t key = (uint64_t)(n + 1) << 32;
+   uint64_t value = key | (uint32_t)res;
+   for (uint32_t i = memo_hash(n), probe = 0; probe < MEMO_SIZE; i = (i + 1) & (MEMO_SIZE - 1), probe++)
+   {
+      uint64_t expected = MEMO_EMPTY;
+      if (memo[i].compare_exchange_strong(expected, value, memory_order_release, memory_order_acquire))
+         return;
+      // Another task already published this value
+      if ((expected & 0xffffffff00000000ull) == key)
+         return;
+   }
+   // Table full, the value is simply not cached
+}
+
+int fib_s(int n)
+{
+   if (n < 2)
+      return n;
+   int res, a, b;
+   bool memoized = use_memo && n >= memo_min;
+   if (memoized && memo_get(n, &res))
+      return res;
+   a = fib_s(n - 1);
+   b = fib_s(n - 2);
+   res = a + b;
+   if (memoized)
+      memo_put(n, res);
+   return res;
+}
+int fib_m(int n, int co)
+{
+   if (co >= CUTOFF)
+      return fib_s(n);
+   if (n < 2)
+      return n;
+   int res, a, b;
+   bool memoized = use_memo && n >= memo_min;
+   if (memoized && memo_get(n, &res))
+      return res;
+   co++;
+   #pragma omp task shared(a)
+   a = fib_m(n - 1, co);
+   #pragma omp task shared(b)
+   b = fib_m(n - 2, co);
+   #pragma omp taskwait
+   res = a + b;
+   if (memoized)
+      memo_put(n, res);
+   return res;
+}
+
+void processwork(struct node *p)
+{
+   int n;
+   n = p->data;
+   p->fibdata = fib_m(n, 1);
+}
+
+struct node *init_list(struct node *p)
+{
+   int i;
+   struct node *head = NULL;
+   struct node *temp = NULL;
+
+   head = (struct node *)malloc(sizeof(struct node));
+   p = head;
+   p->data = FS;
+   p->fibdata = 0;
+   for (i = 0; i < N; i++)
+   {
+      temp = (struct node *)malloc(sizeof(struct node));
+      p->next = temp;
+      p = temp;
+      p->data = FS + i + 1;
+      p->fibdata = i + 1;
+   }
+   p->next = NULL;
+   return head;
+}
+
+int main(int argc, char *argv[])
+{
+   // Read command line arguments.
+   for (int i = 0; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-num_node") == 0))
+      {
+         N = atoi(argv[++i]);
+         printf("  User num_node is %d\n", N);
+      }
+      else if ((strcmp(argv[i], "-T") == 0))
+      {
+         num_threads = atoi(argv[++i]);
+         printf("  User num_threads is %d\n", num_threads);
+         omp_set_num_threads(num_threads);
+      }
+      else if (strcmp(argv[i], "-memo") == 0)
+      {
+         use_memo = true;
+         printf("  Shared memo table enabled\n");
+      }
+      else if (strcmp(argv[i], "-memo_min") == 0)
+      {
+         memo_min = atoi(argv[++i]);
+         printf("  User memo_min is %d\n", memo_min);
+      }
+      else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+      {
+         printf("  Fib Options:\n");
+         printf("  -num_node (-N) <int>:  Number of node computing fibonnaci numbers (by default 5)\n");
+         printf("  -memo:                 share a memo table between all the tasks (disabled by default)\n");
+         printf("  -memo_min <int>:       smallest fibonacci index stored in the memo table (by default 20)\n");
+         printf("  -help (-h):            print this message\n\n");
+         exit(1);
+      }
+   }
+
+   struct node *p = NULL;
+   struct node *temp = NULL;
+   struct node *head = NULL;
+
+   printf("Process linked list\n");
+   printf("  Each linked list node will be processed by function 'processwork()'\n");
+   printf("  Each ll node will compute %d fibonacci numbers beginning with %d\n", N, FS);
+
+   p = init_list(p);
+   head = p;
+
+   for (int i = 0; i < MEMO_SIZE; i++)
+   {
+      memo[i].store(MEMO_EMPTY, memory_order_relaxed);
+   }
+   int max_threads = omp_get_max_threads();
+   counters = new memo_counter[max_threads]();
+
+   // Timer products.
+   struct timeval begin, end;
+
+   gettimeofday(&begin, NULL);
+   #pragma omp parallel
+   {
+      #pragma omp single
+      {
+         while (p != NULL)
+         {
+            #pragma omp task firstprivate(p)
+            {
+               processwork(p);
+            }
+            p = p->next;
+         }
+      }
+   }
+
+   gettimeofday(&end, NULL);
+
+   // Calculate time.
+   double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                 1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+   uint64_t hits = 0, misses = 0;
+   for (int i = 0; i < max_threads; i++)
+   {
+      hits += counters[i].hits;
+      misses += counters[i].misses;
+   }
+   delete[] counters;
+
+   p = head;
+   while (p != NULL)
+   {
+      printf("%d : %d\n", p->data, p->fibdata);
+      temp = p->next;
+      free(p);
+      p = temp;
+   }
+   free(p);
+
+   printf("Compute Time: %f seconds\n", time);
+   if (use_memo)
+   {
+      printf("Memo hits: %lu misses: %lu\n", (unsigned long)hits, (unsigned long)misses);
+   }
+   write_perf_csv(num_threads, N, time);
+   write_memo_csv(num_threads, N, time, hits, misses);
+   return 0;
+}
@@ -0,0 +1,457 @@
+/*
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <iostream>
+#include <omp.h>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <string>
+#include "work_stealing.hpp"
+#include "coro_task.hpp"
+#include "task_memory.hpp"
+
+using namespace std;
+
+static int N = 5;
+int num_threads = 1;
+
+#ifndef FS
+#define FS 38
+#endif
+
+// Task backends, selected with -B
+enum backend
+{
+   BACKEND_OMP,
+   BACKEND_WS,
+   BACKEND_CORO
+};
+
+static const char *backend_names[] = {"omp", "ws", "coro"};
+static const char *backend_csv_names[] = {"3_5 omp tasks", "3_5 work stealing", "3_5 coroutines"};
+
+// OpenMP tasks created, and created but not finished yet, libgomp does not
+// expose the size of its task descriptors nor its queue. Like the coroutine
+// frames, only counted with -count (taskmem::counting): the shared counters
+// would slow the timed run down, the ws workers count on their own.
+static atomic<uint64_t> omp_tasks(0);
+static atomic<int64_t> omp_outstanding(0);
+static atomic<int64_t> omp_peak(0);
+
+struct node
+{
+   int data;
+   int fibdata;
+   struct node *next;
+};
+
+string csv_name(int b)
+{
+   return string(backend_csv_names[b]) + (coro::use_pool ? " pool" : "");
+}
+
+void write_perf_csv(int nb_threads, int n, int b, double runtime)
+{
+   ofstream myfile;
+   myfile.open("stats_part3.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << csv_name(b)
+          << "," << nb_threads << "," << n << "," << runtime << "\n";
+
+   myfile.close();
+}
+
+// Unknown values (task bytes and live bytes of libgomp, tasks not
+// counted) are left empty
+void write_memory_csv(int nb_threads, int n, int b, double runtime, int64_t tasks, long task_bytes,
+                      int64_t peak_depth, long peak_live, long peak_rss)
+{
+   ofstream myfile;
+   myfile.open("stats_part3_memory.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << csv_name(b)
+          << "," << nb_threads << "," << n << "," << runtime << ",";
+   if (tasks >= 0)
+      myfile << tasks;
+   myfile << ",";
+   if (task_bytes >= 0)
+      myfile << task_bytes;
+   myfile << ",";
+   if (peak_depth >= 0)
+      myfile << peak_depth;
+   myfile << ",";
+   if (peak_live >= 0)
+      myfile << peak_live;
+   myfile << "," << peak_rss << "\n";
+
+   myfile.close();
+}
+
+void omp_task_created()
+{
+   if (!taskmem::counting)
+      return;
+   omp_tasks.fetch_add(1, memory_order_relaxed);
+   int64_t live = omp_outstanding.fetch_add(1, memory_order_relaxed) + 1;
+   int64_t peak = omp_peak.load(memory_order_relaxed);
+   while (live > peak && !omp_peak.compare_exchange_weak(peak, live, memory_order_relaxed))
+      ;
+}
+
+void omp_task_done()
+{
+   if (!taskmem::counting)
+      return;
+   omp_outstanding.fetch_sub(1, memory_order_relaxed);
+}
+
+//
+#define CUTOFF 5
+int fib_s(int n)
+{
+   if (n < 2)
+      return n;
+   int res, a, b;
+   a = fib_s(n - 1);
+   b = fib_s(n - 2);
+   res = a + b;
+   return res;
+}
+int fib_m(int n, int co)
+{
+   if (co >= CUTOFF)
+      return fib_s(n);
+   if (n < 2)
+      return n;
+   int res, a, b;
+   co++;
+   omp_task_created();
+   #pragma omp task shared(a)
+   {
+      a = fib_m(n - 1, co);
+      omp_task_done();
+   }
+   omp_task_created();
+   #pragma omp task shared(b)
+   {
+      b = fib_m(n - 2, co);
+      omp_task_done();
+   }
+   #pragma omp taskwait
+   res = a + b;
+   return res;
+}
+// Same recursion on the work stealing runtime, only fib(n - 1) is spawned,
+// fib(n - 2) is the continuation executed by the spawning worker
+int fib_ws(int n, int co);
+
+// Spawned half of fib_ws, named so its job size can be reported
+struct fib_ws_left
+{
+   int *a;
+   int n;
+   int co;
+
+   void operator()() const
+   {
+      *a = fib_ws(n - 1, co);
+   }
+};
+
+int fib_ws(int n, int co)
+{
+   if (co >= CUTOFF)
+      return fib_s(n);
+   if (n < 2)
+      return n;
+   int res, a, b;
+   co++;
+   ws::frame fr;
+   auto left = ws::make_job(fib_ws_left{&a, n, co});
+   fr.spawn(left);
+   b = fib_ws(n - 2, co);
+   fr.sync();
+   res = a + b;
+   return res;
+}
+
+// Coroutine version, fib(n - 1) is forked and stealable, fib(n - 2) runs
+// inline through symmetric transfer
+coro::task<int> fib_coro(int n, int co)
+{
+   if (co >= CUTOFF)
+      co_return fib_s(n);
+   if (n < 2)
+      co_return n;
+   co++;
+   coro::task<int> left = coro::fork(fib_coro(n - 1, co));
+   int b = co_await fib_coro(n - 2, co);
+   int a = co_await left;
+   co_return a + b;
+}
+
+void processwork(struct node *p, int b)
+{
+   int n;
+   n = p->data;
+   if (b == BACKEND_WS)
+      p->fibdata = fib_ws(n, 1);
+   else
+      p->fibdata = fib_m(n, 1);
+}
+
+coro::task<void> processwork_coro(struct node *p)
+{
+   p->fibdata = co_await fib_coro(p->data, 1);
+}
+
+struct node *init_list(struct node *p)
+{
+   int i;
+   struct node *head = NULL;
+   struct node *temp = NULL;
+
+   head = (struct node *)malloc(sizeof(struct node));
+   p = head;
+   p->data = FS;
+   p->fibdata = 0;
+   for (i = 0; i < N; i++)
+   {
+      temp = (struct node *)malloc(sizeof(struct node));
+      p->next = temp;
+      p = temp;
+      p->data = FS + i + 1;
+      p->fibdata = i + 1;
+   }
+   p->next = NULL;
+   return head;
+}
+
+void process_list_omp(struct node *p)
+{
+   #pragma omp parallel
+   {
+      #pragma omp single
+      {
+         while (p != NULL)
+         {
+            omp_task_created();
+            #pragma omp task firstprivate(p)
+            {
+               processwork(p, BACKEND_OMP);
+               omp_task_done();
+            }
+            p = p->next;
+         }
+      }
+   }
+}
+
+void process_list_ws(ws::scheduler &sched, struct node *p)
+{
+   auto make_node_job = [](struct node *q) { return ws::make_job([q] { processwork(q, BACKEND_WS); }); };
+   vector<decltype(make_node_job(NULL))> jobs;
+   jobs.reserve(N + 1);
+
+   sched.run([&] {
+      ws::frame fr;
+      while (p != NULL)
+      {
+         jobs.push_back(make_node_job(p));
+         fr.spawn(jobs.back());
+         p = p->next;
+      }
+      fr.sync();
+   });
+}
+
+coro::task<void> process_list_coro(struct node *p)
+{
+   vector<coro::task<void>> tasks;
+   while (p != NULL)
+   {
+      tasks.push_back(coro::fork(processwork_coro(p)));
+      p = p->next;
+   }
+   for (coro::task<void> &t : tasks)
+      co_await t;
+}
+
+int main(int argc, char *argv[])
+{
+   int b = BACKEND_OMP;
+   // The ws and coro schedulers get as many workers as the omp team
+   num_threads = omp_get_max_threads();
+
+   // Read command line arguments.
+   for (int i = 0; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-num_node") == 0))
+      {
+         N = atoi(argv[++i]);
+         printf("  User num_node is %d\n", N);
+      }
+      else if ((strcmp(argv[i], "-T") == 0))
+      {
+         num_threads = atoi(argv[++i]);
+         printf("  User num_threads is %d\n", num_threads);
+         omp_set_num_threads(num_threads);
+      }
+      else if ((strcmp(argv[i], "-B") == 0) || (strcmp(argv[i], "-backend") == 0))
+      {
+         i++;
+         for (b = 0; b <= BACKEND_CORO; b++)
+         {
+            if (strcmp(argv[i], backend_names[b]) == 0)
+               break;
+         }
+         if (b > BACKEND_CORO)
+         {
+            printf("  Unknown backend %s\n", argv[i]);
+            exit(1);
+         }
+         printf("  User backend is %s\n", backend_names[b]);
+      }
+      else if (strcmp(argv[i], "-pool") == 0)
+      {
+         coro::use_pool = true;
+         printf("  Coroutine frames allocated from per-thread slabs\n");
+      }
+      else if (strcmp(argv[i], "-count") == 0)
+      {
+         taskmem::counting = true;
+         printf("  Tasks and task memory counted (slows the omp and coro backends down)\n");
+      }
+      else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+      {
+         printf("  Fib Options:\n");
+         printf("  -num_node (-N) <int>:  Number of node computing fibonnaci numbers (by default 5)\n");
+         printf("  -backend (-B) <name>:  omp (omp task / taskwait), ws (work stealing) or coro (coroutines), by default omp\n");
+         printf("  -pool:                 coroutine frames come from per-thread slabs (coro backend)\n");
+         printf("  -count:                count the tasks, the peak of outstanding tasks and the task memory\n");
+         printf("                         (omp and coro backends, with shared atomics)\n");
+         printf("  -help (-h):            print this message\n\n");
+         exit(1);
+      }
+   }
+
+   struct node *p = NULL;
+   struct node *temp = NULL;
+   struct node *head = NULL;
+
+   printf("Process linked list\n");
+   printf("  Each linked list node will be processed by function 'processwork()'\n");
+   printf("  Each ll node will compute %d fibonacci numbers beginning with %d\n", N, FS);
+
+   p = init_list(p);
+   head = p;
+
+   // The worker threads are started before the timer, as the OpenMP ones
+   // are kept alive by the runtime once created
+   ws::scheduler *sched = NULL;
+   if (b == BACKEND_WS || b == BACKEND_CORO)
+      sched = new ws::scheduler(num_threads);
+
+   // Timer products.
+   struct timeval begin, end;
+
+   gettimeofday(&begin, NULL);
+
+   if (b == BACKEND_WS)
+      process_list_ws(*sched, p);
+   else if (b == BACKEND_CORO)
+   {
+      coro::task<void> root = process_list_coro(p);
+      sched->run([&] { coro::sync_wait(root); });
+   }
+   else
+      process_list_omp(p);
+
+   gettimeofday(&end, NULL);
+
+   // Calculate time.
+   double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                 1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+   // Memory accounting of the run
+   int64_t tasks = 0;
+   long task_bytes = -1, peak_live = -1;
+   int64_t peak_depth = 0;
+   if (sched != NULL)
+   {
+      for (int i = 0; i < sched->size(); i++)
+      {
+         const ws::worker &w = sched->get(i);
+         printf("  worker %d: %lu spawns, %lu steals, %lu inlined, peak deque depth %ld\n", i,
+                (unsigned long)w.spawns, (unsigned long)w.steals, (unsigned long)w.inlined, (long)w.peak_depth);
+         tasks += w.spawns;
+         if (w.peak_depth > peak_depth)
+            peak_depth = w.peak_depth;
+      }
+      delete sched;
+   }
+   if (b == BACKEND_WS)
+   {
+      // The jobs live in the spawning stack frames, nothing is allocated
+      task_bytes = sizeof(ws::job_of<fib_ws_left>);
+      peak_live = 0;
+   }
+   else if (b == BACKEND_CORO)
+   {
+      // Every awaited call allocates a frame, forked or not
+      tasks = taskmem::counting ? (int64_t)coro::frames.load() : -1;
+      if (taskmem::counting)
+      {
+         task_bytes = tasks > 0 ? coro::frame_bytes.load() / tasks : 0;
+         peak_live = taskmem::peak_bytes.load();
+      }
+   }
+   else
+   {
+      tasks = taskmem::counting ? (int64_t)omp_tasks.load() : -1;
+      peak_depth = taskmem::counting ? omp_peak.load() : -1;
+   }
+   long peak_rss = taskmem::peak_rss_kb();
+   if (tasks >= 0)
+      printf("  tasks: %ld, bytes per task: ", (long)tasks);
+   else
+      printf("  tasks: not counted (-count), bytes per task: ");
+   const char *unknown = b == BACKEND_OMP ? "unknown (libgomp)" : "not counted";
+   if (task_bytes >= 0)
+      printf("%ld", task_bytes);
+   else
+      printf("%s", unknown);
+   if (peak_depth >= 0)
+      printf(", peak queue depth: %ld, peak task memory: ", (long)peak_depth);
+   else
+      printf(", peak queue depth: not counted, peak task memory: ");
+   if (peak_live >= 0)
+      printf("%ld bytes", peak_live);
+   else
+      printf("%s", unknown);
+   printf(", peak RSS: %ld KB\n", peak_rss);
+
+   p = head;
+   while (p != NULL)
+   {
+      printf("%d : %d\n", p->data, p->fibdata);
+      temp = p->next;
+      free(p);
+      p = temp;
+   }
+   free(p);
+
+   printf("Compute Time: %f seconds\n", time);
+   write_perf_csv(num_threads, N, b, time);
+   write_memory_csv(num_threads, N, b, time, tasks, task_bytes, peak_depth, peak_live, peak_rss);
+   return 0;
+}
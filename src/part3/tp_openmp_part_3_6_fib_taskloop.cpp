@@ -0,0 +1,275 @@
+/*
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <iostream>
+#include <omp.h>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static int N = 5;
+int num_threads = 1;
+
+#ifndef FS
+#define FS 38
+#endif
+
+// Tasking constructs compared, selected with -V
+enum variant
+{
+   VARIANT_GRAINSIZE, // taskloop grainsize(g) over the nodes, sequential fib
+   VARIANT_NUM_TASKS, // taskloop num_tasks(k) over the nodes, sequential fib
+   VARIANT_TASKGROUP  // taskloop over the nodes, taskgroup + task_reduction recursion
+};
+
+static const char *variant_names[] = {"grainsize", "num_tasks", "taskgroup"};
+
+struct node
+{
+   int data;
+   int fibdata;
+   struct node *next;
+};
+
+void write_perf_csv(const string &name, int nb_threads, int n, double runtime)
+{
+   ofstream myfile;
+   myfile.open("stats_part3.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << name
+          << "," << nb_threads << "," << n << "," << runtime << "\n";
+
+   myfile.close();
+}
+
+//
+#define CUTOFF 5
+int fib_s(int n)
+{
+   if (n < 2)
+      return n;
+   int res, a, b;
+   a = fib_s(n - 1);
+   b = fib_s(n - 2);
+   res = a + b;
+   return res;
+}
+// Both children add into the reduction of the enclosing taskgroup,
+// the end of the taskgroup replaces the taskwait
+int fib_tg(int n, int co)
+{
+   if (co >= CUTOFF)
+      return fib_s(n);
+   if (n < 2)
+      return n;
+   int res = 0;
+   co++;
+   #pragma omp taskgroup task_reduction(+ : res)
+   {
+      #pragma omp task in_reduction(+ : res)
+      res += fib_tg(n - 1, co);
+      #pragma omp task in_reduction(+ : res)
+      res += fib_tg(n - 2, co);
+   }
+   return res;
+}
+
+struct node *init_list(struct node *p)
+{
+   int i;
+   struct node *head = NULL;
+   struct node *temp = NULL;
+
+   head = (struct node *)malloc(sizeof(struct node));
+   p = head;
+   p->data = FS;
+   p->fibdata = 0;
+   for (i = 0; i < N; i++)
+   {
+      temp = (struct node *)malloc(sizeof(struct node));
+      p->next = temp;
+      p = temp;
+      p->data = FS + i + 1;
+      p->fibdata = i + 1;
+   }
+   p->next = NULL;
+   return head;
+}
+
+// taskloop needs a countable loop, the nodes are indexed once before the timer
+vector<struct node *> list_to_array(struct node *p)
+{
+   vector<struct node *> nodes;
+   while (p != NULL)
+   {
+      nodes.push_back(p);
+      p = p->next;
+   }
+   return nodes;
+}
+
+double process_nodes(vector<struct node *> &nodes, int v, int param)
+{
+   struct node **a = nodes.data();
+   int count = nodes.size();
+
+   // Timer products.
+   struct timeval begin, end;
+
+   gettimeofday(&begin, NULL);
+   #pragma omp parallel
+   {
+      #pragma omp single
+      {
+         if (v == VARIANT_GRAINSIZE)
+         {
+            #pragma omp taskloop grainsize(param)
+            for (int i = 0; i < count; i++)
+               a[i]->fibdata = fib_s(a[i]->data);
+         }
+         else if (v == VARIANT_NUM_TASKS)
+         {
+            #pragma omp taskloop num_tasks(param)
+            for (int i = 0; i < count; i++)
+               a[i]->fibdata = fib_s(a[i]->data);
+         }
+         else
+         {
+            #pragma omp taskloop grainsize(1)
+            for (int i = 0; i < count; i++)
+               a[i]->fibdata = fib_tg(a[i]->data, 1);
+         }
+      }
+   }
+   gettimeofday(&end, NULL);
+
+   // Calculate time.
+   return 1.0 * (end.tv_sec - begin.tv_sec) +
+          1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+string csv_name(int v, int param)
+{
+   if (v == VARIANT_TASKGROUP)
+      return "3_6 taskgroup reduction";
+   return string("3_6 taskloop ") + variant_names[v] + " " + to_string(param);
+}
+
+int main(int argc, char *argv[])
+{
+   int v = VARIANT_GRAINSIZE;
+   int param = 1;
+   bool sweep = false;
+
+   // Read command line arguments.
+   for (int i = 0; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-num_node") == 0))
+      {
+         N = atoi(argv[++i]);
+         printf("  User num_node is %d\n", N);
+      }
+      else if ((strcmp(argv[i], "-T") == 0))
+      {
+         num_threads = atoi(argv[++i]);
+         printf("  User num_threads is %d\n", num_threads);
+         omp_set_num_threads(num_threads);
+      }
+      else if ((strcmp(argv[i], "-V") == 0) || (strcmp(argv[i], "-variant") == 0))
+      {
+         i++;
+         for (v = 0; v <= VARIANT_TASKGROUP; v++)
+         {
+            if (strcmp(argv[i], variant_names[v]) == 0)
+               break;
+         }
+         if (v > VARIANT_TASKGROUP)
+         {
+            printf("  Unknown variant %s\n", argv[i]);
+            exit(1);
+         }
+         printf("  User variant is %s\n", variant_names[v]);
+      }
+      else if ((strcmp(argv[i], "-G") == 0) || (strcmp(argv[i], "-param") == 0))
+      {
+         param = atoi(argv[++i]);
+         printf("  User grainsize / num_tasks is %d\n", param);
+      }
+      else if (strcmp(argv[i], "-sweep") == 0)
+      {
+         sweep = true;
+      }
+      else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+      {
+         printf("  Fib Options:\n");
+         printf("  -num_node (-N) <int>:  Number of node computing fibonnaci numbers (by default 5)\n");
+         printf("  -variant (-V) <name>:  grainsize, num_tasks or taskgroup (by default grainsize)\n");
+         printf("  -param (-G) <int>:     grainsize or num_tasks of the taskloop (by default 1)\n");
+         printf("  -sweep:                run grainsize and num_tasks 1, 2, 4... up to the number of nodes\n");
+         printf("                         then taskgroup, one csv line each\n");
+         printf("  -help (-h):            print this message\n\n");
+         exit(1);
+      }
+   }
+   if (param < 1)
+   {
+      printf("  grainsize / num_tasks must be greater than 0.\n");
+      exit(1);
+   }
+
+   struct node *p = NULL;
+   struct node *temp = NULL;
+   struct node *head = NULL;
+
+   printf("Process linked list\n");
+   printf("  Each linked list node will be processed by function 'processwork()'\n");
+   printf("  Each ll node will compute %d fibonacci numbers beginning with %d\n", N, FS);
+
+   p = init_list(p);
+   head = p;
+   vector<struct node *> nodes = list_to_array(head);
+
+   vector<pair<int, int>> runs;
+   if (sweep)
+   {
+      for (int g = 1; g <= (int)nodes.size(); g *= 2)
+         runs.push_back(make_pair((int)VARIANT_GRAINSIZE, g));
+      for (int k = 1; k <= (int)nodes.size(); k *= 2)
+         runs.push_back(make_pair((int)VARIANT_NUM_TASKS, k));
+      runs.push_back(make_pair((int)VARIANT_TASKGROUP, 1));
+   }
+   else
+   {
+      runs.push_back(make_pair(v, param));
+   }
+
+   for (size_t r = 0; r < runs.size(); r++)
+   {
+      double time = process_nodes(nodes, runs[r].first, runs[r].second);
+      string name = csv_name(runs[r].first, runs[r].second);
+      printf("%s Compute Time: %f seconds\n", name.c_str(), time);
+      write_perf_csv(name, num_threads, N, time);
+   }
+
+   p = head;
+   while (p != NULL)
+   {
+      printf("%d : %d\n", p->data, p->fibdata);
+      temp = p->next;
+      free(p);
+      p = temp;
+   }
+   free(p);
+
+   return 0;
+}
@@ -0,0 +1,356 @@
+/*
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/time.h>
+#include <unistd.h>
+#include <iostream>
+#include <omp.h>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+static int N = 100;
+int num_threads = 2;
+
+#ifndef FS
+#define FS 38
+#endif
+
+// Number of distinct fibonacci indices generated, FS, FS + 1, ... FS + SPAN - 1
+#ifndef SPAN
+#define SPAN 5
+#endif
+
+// Capacity of the work queue, must be a power of two
+#ifndef QUEUE_SIZE
+#define QUEUE_SIZE 1024
+#endif
+
+struct node
+{
+   int data;
+   int fibdata;
+   double arrival; // omp_get_wtime() when produced
+   double latency; // from arrival to the end of processwork
+   struct node *next;
+};
+
+// Bounded lock-free queue (D. Vyukov), each cell sequence number tells whether
+// it is ready to be written or read at the current position. Safe for any
+// number of producers and consumers, here one producer feeds every worker.
+class work_queue
+{
+ public:
+   work_queue() : enqueue_pos(0), dequeue_pos(0)
+   {
+      for (size_t i = 0; i < QUEUE_SIZE; i++)
+         cells[i].sequence.store(i, memory_order_relaxed);
+   }
+
+   bool push(struct node *p)
+   {
+      size_t pos = enqueue_pos.load(memory_order_relaxed);
+      for (;;)
+      {
+         cell &c = cells[pos & (QUEUE_SIZE - 1)];
+         size_t seq = c.sequence.load(memory_order_acquire);
+         intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+         if (diff == 0)
+         {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+            {
+               c.data = p;
+               c.sequence.store(pos + 1, memory_order_release);
+               return true;
+            }
+         }
+         else if (diff < 0)
+         {
+            return false; // full
+         }
+         else
+         {
+            pos = enqueue_pos.load(memory_order_relaxed);
+         }
+      }
+   }
+
+   struct node *pop()
+   {
+      size_t pos = dequeue_pos.load(memory_order_relaxed);
+      for (;;)
+      {
+         cell &c = cells[pos & (QUEUE_SIZE - 1)];
+         size_t seq = c.sequence.load(memory_order_acquire);
+         intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+         if (diff == 0)
+         {
+            if (dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+            {
+               struct node *p = c.data;
+               c.sequence.store(pos + QUEUE_SIZE, memory_order_release);
+               return p;
+            }
+         }
+         else if (diff < 0)
+         {
+            return NULL; // empty
+         }
+         else
+         {
+            pos = dequeue_pos.load(memory_order_relaxed);
+         }
+      }
+   }
+
+ private:
+   struct cell
+   {
+      atomic<size_t> sequence;
+      struct node *data;
+   };
+
+   alignas(64) cell cells[QUEUE_SIZE];
+   alignas(64) atomic<size_t> enqueue_pos;
+   alignas(64) atomic<size_t> dequeue_pos;
+};
+
+void write_perf_csv(int nb_threads, int n, double runtime)
+{
+   ofstream myfile;
+   myfile.open("stats_part3.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << "3_7 streaming"
+          << "," << nb_threads << "," << n << "," << runtime << "\n";
+
+   myfile.close();
+}
+
+void write_stream_csv(int nb_threads, int n, double rate, double runtime, double throughput,
+                      double p50, double p90, double p99, double pmax)
+{
+   ofstream myfile;
+   myfile.open("stats_part3_stream.csv", ios_base::app);
+   myfile.precision(8);
+   myfile << "3_7 streaming"
+          << "," << nb_threads << "," << n << "," << rate << "," << runtime << "," << throughput
+          << "," << p50 << "," << p90 << "," << p99 << "," << pmax << "\n";
+
+   myfile.close();
+}
+
+int fib(int n)
+{
+   int x, y;
+   if (n < 2)
+   {
+      return (n);
+   }
+   else
+   {
+      x = fib(n - 1);
+      y = fib(n - 2);
+      return (x + y);
+   }
+}
+
+void processwork(struct node *p)
+{
+   int n;
+   n = p->data;
+   p->fibdata = fib(n);
+}
+
+// Fibonacci indices of the items, read from a file (one per line) or generated
+vector<int> load_items(const char *input)
+{
+   vector<int> items;
+   if (input != NULL)
+   {
+      ifstream in(input);
+      if (!in.good())
+      {
+         printf("  Cannot open %s\n", input);
+         exit(1);
+      }
+      int v;
+      while (in >> v)
+         items.push_back(v);
+      N = items.size();
+   }
+   else
+   {
+      for (int i = 0; i < N; i++)
+         items.push_back(FS + i % SPAN);
+   }
+   return items;
+}
+
+double percentile(const vector<double> &sorted, double q)
+{
+   if (sorted.empty())
+      return 0;
+   size_t i = (size_t)(q * (sorted.size() - 1) + 0.5);
+   return sorted[i];
+}
+
+int main(int argc, char *argv[])
+{
+   double rate = 0;
+   const char *input = NULL;
+
+   // Read command line arguments.
+   for (int i = 0; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-N") == 0) || (strcmp(argv[i], "-num_node") == 0))
+      {
+         N = atoi(argv[++i]);
+         printf("  User num_node is %d\n", N);
+      }
+      else if ((strcmp(argv[i], "-T") == 0))
+      {
+         num_threads = atoi(argv[++i]);
+         printf("  User num_threads is %d\n", num_threads);
+      }
+      else if ((strcmp(argv[i], "-R") == 0) || (strcmp(argv[i], "-rate") == 0))
+      {
+         rate = atof(argv[++i]);
+         printf("  User rate is %g items/s\n", rate);
+      }
+      else if ((strcmp(argv[i], "-I") == 0) || (strcmp(argv[i], "-input") == 0))
+      {
+         input = argv[++i];
+         printf("  User input is %s\n", input);
+      }
+      else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0))
+      {
+         printf("  Fib Options:\n");
+         printf("  -num_node (-N) <int>:  Number of generated items (by default 100)\n");
+         printf("  -rate (-R) <float>:    items produced per second, 0 for as fast as possible (by default 0)\n");
+         printf("  -input (-I) <file>:    read the fibonacci indices from a file instead of generating them\n");
+         printf("  -T <int>:              threads, one producer and T - 1 workers (by default 2)\n");
+         printf("  -help (-h):            print this message\n\n");
+         exit(1);
+      }
+   }
+   // One producer and at least one worker
+   if (num_threads < 2)
+      num_threads = 2;
+   omp_set_num_threads(num_threads);
+
+   vector<int> items = load_items(input);
+   vector<struct node> nodes(N);
+   work_queue *queue = new work_queue();
+   atomic<bool> produced(false);
+   uint64_t full = 0;
+   int team = num_threads; // threads actually granted to the region
+
+   printf("Process stream\n");
+   printf("  Each item will be processed by function 'processwork()' on %d workers\n", num_threads - 1);
+
+   // Timer products.
+   struct timeval begin, end;
+
+   gettimeofday(&begin, NULL);
+   #pragma omp parallel
+   {
+      if (omp_get_thread_num() == 0)
+      {
+         // Producer, and the only worker when the runtime granted a single
+         // thread (OMP_THREAD_LIMIT, nested region): nobody would pop
+         team = omp_get_num_threads();
+         bool inline_work = team < 2;
+         double start = omp_get_wtime();
+         for (int i = 0; i < N; i++)
+         {
+            if (rate > 0)
+            {
+               double due = start + i / rate;
+               double wait = due - omp_get_wtime();
+               if (wait > 1e-3)
+                  usleep((useconds_t)(wait * 1e6));
+               while (omp_get_wtime() < due)
+                  ;
+            }
+            struct node *p = &nodes[i];
+            p->data = items[i];
+            p->fibdata = 0;
+            p->next = NULL;
+            p->arrival = omp_get_wtime();
+            if (inline_work)
+            {
+               processwork(p);
+               p->latency = omp_get_wtime() - p->arrival;
+               continue;
+            }
+            while (!queue->push(p))
+               full++;
+         }
+         produced.store(true, memory_order_release);
+      }
+      else
+      {
+         // Workers
+         for (;;)
+         {
+            struct node *p = queue->pop();
+            if (p != NULL)
+            {
+               processwork(p);
+               p->latency = omp_get_wtime() - p->arrival;
+            }
+            else if (produced.load(memory_order_acquire))
+            {
+               // Nothing was pushed after the flag, a last pop decides
+               p = queue->pop();
+               if (p == NULL)
+                  break;
+               processwork(p);
+               p->latency = omp_get_wtime() - p->arrival;
+            }
+         }
+      }
+   }
+   gettimeofday(&end, NULL);
+
+   // Calculate time.
+   double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                 1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+   vector<double> latencies;
+   for (int i = 0; i < N; i++)
+   {
+      latencies.push_back(nodes[i].latency);
+      if (N <= 64)
+         printf("%d : %d\n", nodes[i].data, nodes[i].fibdata);
+   }
+   sort(latencies.begin(), latencies.end());
+   if (team < num_threads)
+      printf("  Only %d threads were granted, %s\n", team,
+             team < 2 ? "the producer processed the items itself" : "fewer workers than requested");
+   double throughput = N / time;
+   double p50 = percentile(latencies, 0.50);
+   double p90 = percentile(latencies, 0.90);
+   double p99 = percentile(latencies, 0.99);
+   double pmax = latencies.empty() ? 0 : latencies.back();
+   delete queue;
+
+   printf("Compute Time: %f seconds\n", time);
+   printf("Throughput: %f items/s, producer blocked %lu times on a full queue\n", throughput, (unsigned long)full);
+   printf("Latency p50 %f p90 %f p99 %f max %f seconds\n", p50, p90, p99, pmax);
+   write_perf_csv(team, N, time);
+   write_stream_csv(team, N, rate, time, throughput, p50, p90, p99, pmax);
+
+   return 0;
+}
@@ -0,0 +1,343 @@
+/*
+**  Work stealing task runtime used as an alternative backend to
+**  #pragma omp task / taskwait in the part 3 benchmarks.
+**
+**  Each worker owns a Chase-Lev deque (Le, Pop, Cohen, Zappa Nardelli,
+**  "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013):
+**  the owner pushes and pops at the bottom without any CAS on the fast path,
+**  thieves take the oldest (biggest) job at the top.
+**
+**  Usage, the job objects live in the spawning frame until its sync:
+**
+**     ws::frame fr;
+**     auto left = ws::make_job([&] { a = fib(n - 1); });
+**     fr.spawn(left);
+**     b = fib(n - 2);  // the continuation stays on this worker
+**     fr.sync();       // runs or steals jobs until left is done
+*/
+
+#ifndef TP_OPENMP_WORK_STEALING_HPP
+#define TP_OPENMP_WORK_STEALING_HPP
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace ws
+{
+
+// Capacity of each deque, a spawn on a full deque runs the job inline
+#ifndef WS_DEQUE_SIZE
+#define WS_DEQUE_SIZE 4096
+#endif
+
+class frame;
+
+struct job
+{
+   void (*run)(job *);
+   frame *parent;
+};
+
+template <typename F>
+struct job_of : job
+{
+   F f;
+
+   job_of(F fn) : f(fn)
+   {
+      run = [](job *j) { static_cast<job_of *>(j)->f(); };
+      parent = nullptr;
+   }
+};
+
+template <typename F>
+job_of<F> make_job(F f)
+{
+   return job_of<F>(f);
+}
+
+class deque
+{
+ public:
+   deque() : top(0), bottom(0)
+   {
+   }
+
+   // Owner only
+   bool push(job *j)
+   {
+      int64_t b = bottom.load(std::memory_order_relaxed);
+      int64_t t = top.load(std::memory_order_acquire);
+      if (b - t >= WS_DEQUE_SIZE)
+         return false;
+      buffer[b & (WS_DEQUE_SIZE - 1)].store(j, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_release);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return true;
+   }
+
+   // Owner only
+   job *pop()
+   {
+      int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+      bottom.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t t = top.load(std::memory_order_relaxed);
+      if (t > b)
+      {
+         bottom.store(b + 1, std::memory_order_relaxed);
+         return nullptr;
+      }
+      job *j = buffer[b & (WS_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+      if (t == b)
+      {
+         // Last job, race against the thieves
+         if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            j = nullptr;
+         bottom.store(b + 1, std::memory_order_relaxed);
+      }
+      return j;
+   }
+
+   // Approximate number of queued jobs, exact for the owner
+   int64_t size() const
+   {
+      int64_t n = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+      return n > 0 ? n : 0;
+   }
+
+   // Any thread
+   job *steal()
+   {
+      int64_t t = top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t b = bottom.load(std::memory_order_acquire);
+      if (t >= b)
+         return nullptr;
+      job *j = buffer[t & (WS_DEQUE_SIZE - 1)].load(std::memory_order_acquire);
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+         return nullptr;
+      return j;
+   }
+
+ private:
+   alignas(64) std::atomic<int64_t> top;
+   alignas(64) std::atomic<int64_t> bottom;
+   alignas(64) std::atomic<job *> buffer[WS_DEQUE_SIZE];
+};
+
+struct worker
+{
+   int id;
+   deque jobs;
+   uint32_t seed;
+   uint64_t spawns;
+   uint64_t steals;
+   uint64_t inlined;
+   int64_t peak_depth; // deepest the deque has been
+};
+
+inline void note_depth(worker *w)
+{
+   int64_t depth = w->jobs.size();
+   if (depth > w->peak_depth)
+      w->peak_depth = depth;
+}
+
+class scheduler;
+// Worker run by the calling thread, and the scheduler it belongs to
+inline thread_local worker *current_worker = nullptr;
+inline scheduler *current_scheduler = nullptr;
+
+class scheduler
+{
+ public:
+   // The calling thread is worker 0, nb_threads - 1 threads are started
+   explicit scheduler(int nb_threads) : workers(nb_threads), running(false), stop(false)
+   {
+      for (int i = 0; i < nb_threads; i++)
+      {
+         workers[i] = new worker();
+         workers[i]->id = i;
+         workers[i]->seed = 2463534242u + i;
+      }
+      current_scheduler = this;
+      current_worker = workers[0];
+      for (int i = 1; i < nb_threads; i++)
+         threads.emplace_back(&scheduler::worker_loop, this, workers[i]);
+   }
+
+   ~scheduler()
+   {
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         stop = true;
+      }
+      wake.notify_all();
+      for (std::thread &t : threads)
+         t.join();
+      for (worker *w : workers)
+         delete w;
+      current_scheduler = nullptr;
+      current_worker = nullptr;
+   }
+
+   // Runs root on the calling thread while the other workers steal
+   template <typename F>
+   void run(F root)
+   {
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         running = true;
+      }
+      wake.notify_all();
+      root();
+      running = false;
+   }
+
+   int size() const
+   {
+      return workers.size();
+   }
+
+   const worker &get(int i) const
+   {
+      return *workers[i];
+   }
+
+   job *steal(worker *self)
+   {
+      int n = workers.size();
+      if (n < 2)
+         return nullptr;
+      // xorshift victim selection
+      self->seed ^= self->seed << 13;
+      self->seed ^= self->seed >> 17;
+      self->seed ^= self->seed << 5;
+      int victim = self->seed % n;
+      if (victim == self->id)
+         victim = (victim + 1) % n;
+      job *j = workers[victim]->jobs.steal();
+      if (j != nullptr)
+         self->steals++;
+      return j;
+   }
+
+ private:
+   void worker_loop(worker *self);
+
+   std::vector<worker *> workers;
+   std::vector<std::thread> threads;
+   std::atomic<bool> running;
+   bool stop;
+   std::mutex lock;
+   std::condition_variable wake;
+};
+
+class frame
+{
+ public:
+   frame() : pending(0)
+   {
+   }
+
+   template <typename F>
+   void spawn(job_of<F> &j)
+   {
+      worker *w = current_worker;
+      j.parent = this;
+      w->spawns++;
+      pending.fetch_add(1, std::memory_order_relaxed);
+      if (!w->jobs.push(&j))
+      {
+         w->inlined++;
+         execute(&j);
+      }
+      else
+      {
+         note_depth(w);
+      }
+   }
+
+   // Helps with the other jobs until every job spawned from this frame is done
+   void sync()
+   {
+      help_while([this] { return pending.load(std::memory_order_acquire) != 0; });
+   }
+
+   // Runs local or stolen jobs as long as pred holds
+   template <typename P>
+   static void help_while(P pred)
+   {
+      worker *w = current_worker;
+      while (pred())
+      {
+         job *j = w->jobs.pop();
+         if (j == nullptr)
+            j = current_scheduler->steal(w);
+         if (j != nullptr)
+            execute(j);
+         else
+            std::this_thread::yield();
+      }
+   }
+
+   // A job without parent frame is not waited for by any sync
+   static void execute(job *j)
+   {
+      frame *parent = j->parent;
+      j->run(j);
+      if (parent != nullptr)
+         parent->pending.fetch_sub(1, std::memory_order_release);
+   }
+
+ private:
+   std::atomic<int> pending;
+};
+
+// Makes j available to the other workers, its completion has to be tracked by the caller
+inline void enqueue(job *j)
+{
+   worker *w = current_worker;
+   j->parent = nullptr;
+   w->spawns++;
+   if (!w->jobs.push(j))
+   {
+      w->inlined++;
+      frame::execute(j);
+   }
+   else
+   {
+      note_depth(w);
+   }
+}
+
+inline void scheduler::worker_loop(worker *self)
+{
+   current_worker = self;
+   for (;;)
+   {
+      if (!running.load(std::memory_order_acquire))
+      {
+         std::unique_lock<std::mutex> guard(lock);
+         wake.wait(guard, [this] { return stop || running.load(); });
+         if (stop)
+            return;
+      }
+      job *j = self->jobs.pop();
+      if (j == nullptr)
+         j = steal(self);
+      if (j != nullptr)
+         frame::execute(j);
+      else
+         std::this_thread::yield();
+   }
+}
+
+} // namespace ws
+
+#endif
@@ -0,0 +1,285 @@
+/*
+**  PROGRAM: Matrix Multiply, mixed precision
+**
+**  PURPOSE: Computes the product
+**
+**                C  = A * B
+**
+**           with A and B stored in fp64, fp32 or bf16 and the products
+**           accumulated in fp64 or fp32, to compare the throughput and
+**           the accuracy of each precision. A and B hold values in
+**           [-1, 1], sampled rows of C are checked against an fp64
+**           product of the exact values.
+**
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <sys/time.h>
+#include <omp.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../bf16.hpp"
+#include "../huge_alloc.hpp"
+
+using namespace std;
+
+// Rows of C checked against the fp64 reference
+#define CHECK_ROWS 16
+
+// Deterministic values in [-1, 1], so the precision of the storage shows
+double valueAt(uint32_t i, uint32_t j)
+{
+    uint32_t h = i * 2654435761u ^ (j + 0x9e3779b9u) * 40503u;
+    h ^= h >> 15;
+    h *= 2246822519u;
+    h ^= h >> 13;
+    return (h % 2001) / 1000.0 - 1.0;
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int p, double runtime)
+{
+    ofstream myfile;
+    myfile.open("stats_part4.csv", ios_base::app);
+    myfile.precision(8);
+    myfile << name
+           << "," << nb_threads << "," << n << "," << m << "," << p << "," << runtime << "\n";
+
+    myfile.close();
+}
+
+// Same schema as the part 2 precision variant, a GEMM is rows x cols with inner dimension P
+void write_precision_csv(const string &name, const char *storage, const char *accumulate, int nb_threads,
+                         int rows, int cols, int inner, int repeat, double runtime, double gflops, double error)
+{
+    ofstream myfile;
+    myfile.open("stats_precision.csv", ios_base::app);
+    myfile.precision(8);
+    myfile << name << "," << storage << "," << accumulate
+           << "," << nb_threads << "," << rows << "," << cols << "," << inner << "," << repeat
+           << "," << runtime << "," << gflops << "," << error << "\n";
+
+    myfile.close();
+}
+
+// C[i][:] += A[i][k] * B[k][:], the j loop is contiguous and vectorized
+template <typename T, typename Acc>
+void multiply(const T *A, const T *B, Acc *C, int Ndim, int Mdim, int Pdim)
+{
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < Ndim; i++) {
+        Acc *c = C + (size_t)i * Mdim;
+        for (int j = 0; j < Mdim; j++)
+            c[j] = 0;
+        for (int k = 0; k < Pdim; k++) {
+            Acc a = (Acc)A[(size_t)i * Pdim + k];
+            const T *b = B + (size_t)k * Mdim;
+            #pragma omp simd
+            for (int j = 0; j < Mdim; j++)
+                c[j] += a * (Acc)b[j];
+        }
+    }
+}
+
+#ifdef __AVX512BF16__
+// vdpbf16ps multiplies pairs along k: B is repacked so that B[k][j] and
+// B[k + 1][j] are adjacent, and the pair A[i][k], A[i][k + 1] is broadcast.
+// 16 columns of C per instruction, the last Mdim % 16 ones are masked.
+template <>
+void multiply<bf16, float>(const bf16 *A, const bf16 *B, float *C, int Ndim, int Mdim, int Pdim)
+{
+    int pairs = (Pdim + 1) / 2;
+    vector<bf16> Bp((size_t)pairs * Mdim * 2, bf16(0.0f));
+
+    #pragma omp parallel for schedule(static)
+    for (int kk = 0; kk < pairs; kk++)
+        for (int j = 0; j < Mdim; j++)
+            for (int h = 0; h < 2 && 2 * kk + h < Pdim; h++)
+                Bp[((size_t)kk * Mdim + j) * 2 + h] = B[(size_t)(2 * kk + h) * Mdim + j];
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < Ndim; i++) {
+        float *c = C + (size_t)i * Mdim;
+        for (int j = 0; j < Mdim; j++)
+            c[j] = 0;
+        for (int kk = 0; kk < pairs; kk++) {
+            uint32_t pair = A[(size_t)i * Pdim + 2 * kk].bits;
+            if (2 * kk + 1 < Pdim)
+                pair |= (uint32_t)A[(size_t)i * Pdim + 2 * kk + 1].bits << 16;
+            __m512bh a = (__m512bh)_mm512_set1_epi32(pair);
+            const bf16 *b = &Bp[(size_t)kk * Mdim * 2];
+            for (int j = 0; j < Mdim; j += 16) {
+                __mmask16 m = Mdim - j >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (Mdim - j)) - 1);
+                __m512 acc = _mm512_maskz_loadu_ps(m, c + j);
+                acc = _mm512_dpbf16_ps(acc, (__m512bh)_mm512_maskz_loadu_epi32(m, b + 2 * j), a);
+                _mm512_mask_storeu_ps(c + j, m, acc);
+            }
+        }
+    }
+}
+#endif
+
+// Runs C = A * B with storage T and accumulation Acc, returns the runtime
+// and the largest error of the checked rows relative to the largest value.
+// A, B and C use the pages chosen with -pages, their dTLB misses go to tlb_misses.
+template <typename T, typename Acc>
+double run(int Ndim, int Mdim, int Pdim, double &error, long long &tlb_misses)
+{
+    T *A = (T *)huge_alloc((size_t)Ndim * Pdim * sizeof(T));
+    T *B = (T *)huge_alloc((size_t)Pdim * Mdim * sizeof(T));
+    Acc *C = (Acc *)huge_alloc((size_t)Ndim * Mdim * sizeof(Acc));
+
+    /* Initialize matrices */
+
+    #pragma omp parallel for
+    for (int i = 0; i < Ndim; i++)
+        for (int k = 0; k < Pdim; k++)
+            A[(size_t)i * Pdim + k] = T(valueAt(i, k));
+
+    #pragma omp parallel for
+    for (int k = 0; k < Pdim; k++)
+        for (int j = 0; j < Mdim; j++)
+            B[(size_t)k * Mdim + j] = T(valueAt(k + 0x10000000u, j));
+
+    /* Do the matrix product */
+
+    // Timer products.
+    struct timeval begin, end;
+    tlb_counter tlb;
+
+    tlb.start();
+    gettimeofday(&begin, NULL);
+
+    multiply<T, Acc>(A, B, C, Ndim, Mdim, Pdim);
+
+    gettimeofday(&end, NULL);
+    tlb_misses = tlb.stop();
+
+    /* Check the answer */
+
+    double max_err = 0, max_ref = 0;
+    vector<double> ref(Mdim);
+    for (int r = 0; r < CHECK_ROWS && r < Ndim; r++) {
+        int i = (int)((long)Ndim * r / min(CHECK_ROWS, Ndim));
+        fill(ref.begin(), ref.end(), 0.0);
+        for (int k = 0; k < Pdim; k++) {
+            double a = valueAt(i, k);
+            for (int j = 0; j < Mdim; j++)
+                ref[j] += a * valueAt(k + 0x10000000u, j);
+        }
+        for (int j = 0; j < Mdim; j++) {
+            max_err = max(max_err, fabs((double)C[(size_t)i * Mdim + j] - ref[j]));
+            max_ref = max(max_ref, fabs(ref[j]));
+        }
+    }
+    error = max_ref > 0 ? max_err / max_ref : max_err;
+
+    huge_free(A, (size_t)Ndim * Pdim * sizeof(T));
+    huge_free(B, (size_t)Pdim * Mdim * sizeof(T));
+    huge_free(C, (size_t)Ndim * Mdim * sizeof(Acc));
+
+    // Calculate time.
+    return 1.0 * (end.tv_sec - begin.tv_sec) +
+           1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+int main(int argc, char **argv)
+{
+    int Ndim = 1000, Pdim = 1000, Mdim = 1000;   /* A[N][P], B[P][M], C[N][M] */
+    int nb_threads = omp_get_max_threads();
+    string storage = "fp64";
+    string accumulate = "fp64";
+
+    // Read command line arguments.
+    for (int i = 0; i < argc; i++) {
+        if ((strcmp(argv[i], "-N") == 0)) {
+            Ndim = atoi(argv[++i]);
+            printf("  User N is %d\n", Ndim);
+        } else if ((strcmp(argv[i], "-M") == 0)) {
+            Mdim = atoi(argv[++i]);
+            printf("  User M is %d\n", Mdim);
+        } else if ((strcmp(argv[i], "-P") == 0)) {
+            Pdim = atoi(argv[++i]);
+            printf("  User P is %d\n", Pdim);
+        } else if ((strcmp(argv[i], "-T") == 0)) {
+            nb_threads = atoi(argv[++i]);
+            omp_set_num_threads(nb_threads);
+            printf("  User num_threads is %d\n", nb_threads);
+        } else if ((strcmp(argv[i], "-precision") == 0)) {
+            storage = argv[++i];
+            printf("  User storage is %s\n", storage.c_str());
+        } else if ((strcmp(argv[i], "-accumulate") == 0)) {
+            accumulate = argv[++i];
+            printf("  User accumulation is %s\n", accumulate.c_str());
+        } else if ((strcmp(argv[i], "-pages") == 0)) {
+            huge_pages.mode = parse_page_mode(argv[++i]);
+            printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+        } else if ((strcmp(argv[i], "-interleave") == 0)) {
+            huge_pages.interleave = true;
+            printf("  A, B and C are interleaved over the NUMA nodes\n");
+        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0)) {
+            printf("  Matrix multiplication Options:\n");
+            printf("  -N <int>:              Size of the dimension N (by default 1000)\n");
+            printf("  -M <int>:              Size of the dimension M (by default 1000)\n");
+            printf("  -P <int>:              Size of the dimension P (by default 1000)\n");
+            printf("  -T <int>:              Number of threads (by default the OpenMP default)\n");
+            printf("  -precision <name>:     storage of A and B, fp64, fp32 or bf16 (by default fp64)\n");
+            printf("  -accumulate <name>:    accumulation and storage of C, fp64 or fp32 (by default fp64)\n");
+            printf("  -pages <name>:         pages of A, B and C, default, thp, 2m or 1g (by default default)\n");
+            printf("  -interleave:           interleave A, B and C over the NUMA nodes\n");
+            printf("  -help (-h):            print this message\n\n");
+            exit(1);
+        }
+    }
+
+    double time = 0, error = 0;
+    long long tlb_misses = -1;
+    if (storage == "fp64" && accumulate == "fp64")
+        time = run<double, double>(Ndim, Mdim, Pdim, error, tlb_misses);
+    else if (storage == "fp32" && accumulate == "fp64")
+        time = run<float, double>(Ndim, Mdim, Pdim, error, tlb_misses);
+    else if (storage == "fp32" && accumulate == "fp32")
+        time = run<float, float>(Ndim, Mdim, Pdim, error, tlb_misses);
+    else if (storage == "bf16" && accumulate == "fp64")
+        time = run<bf16, double>(Ndim, Mdim, Pdim, error, tlb_misses);
+    else if (storage == "bf16" && accumulate == "fp32")
+        time = run<bf16, float>(Ndim, Mdim, Pdim, error, tlb_misses);
+    else {
+        printf("  Unsupported storage %s with accumulation %s\n", storage.c_str(), accumulate.c_str());
+        exit(1);
+    }
+
+    printf(" N %d M %d P %d multiplication in %f seconds \n", Ndim, Mdim, Pdim, time);
+
+    double mflops = 2.0 * (double)Ndim * (double)Mdim * (double)Pdim / (1000000.0 * time);
+
+    printf(" N %d M %d P %d multiplication at %f mflops\n", Ndim, Mdim, Pdim, mflops);
+    printf(" storage %s accumulation %s relative error %g\n", storage.c_str(), accumulate.c_str(), error);
+    if (storage == "bf16" && accumulate == "fp32")
+        printf(" bf16 kernel: %s\n", bf16_kernel_name());
+    printf(" pages %s%s, system THP policy: %s\n", page_mode_names[huge_pages.mode],
+           huge_pages.interleave ? " interleaved" : "", thp_policy());
+    if (tlb_misses >= 0)
+        printf(" dTLB load misses %lld\n", tlb_misses);
+    else
+        printf(" dTLB load misses not available (perf_event_paranoid?)\n");
+
+    string base = "4_1 " + storage + " acc " + accumulate;
+    string name = base + huge_suffix();
+    write_perf_csv(name, nb_threads, Ndim, Mdim, Pdim, time);
+    write_pages_csv(base, nb_threads, Ndim, Mdim, Pdim, time, tlb_misses);
+    write_precision_csv(name, storage.c_str(), accumulate.c_str(), nb_threads, Ndim, Mdim, Pdim, 1, time,
+                        mflops / 1000, error);
+
+    printf("\n all done \n");
+    return 0;
+}
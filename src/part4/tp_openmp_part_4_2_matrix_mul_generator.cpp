@@ -0,0 +1,349 @@
+/*
+**  PROGRAM: Matrix Multiply, generated inputs
+**
+**  PURPOSE: Computes the product
+**
+**                C  = A * B
+**
+**           with A and B given by a generator (constant AVAL and BVAL as
+**           in the original program, random, banded or Toeplitz). In fill
+**           mode A, B and C are initialized in parallel, each row first
+**           touched by the thread that uses it. In fly mode A is never
+**           stored: each row of A is evaluated when its row of C is
+**           computed, only over its nonzero range for a banded A.
+**           C is checked with Freivalds' algorithm (A (B v) = C v for
+**           random v), or sampled rows are recomputed from the generator.
+**
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <sys/time.h>
+#include <omp.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../generator.hpp"
+#include "../freivalds.hpp"
+#include "../huge_alloc.hpp"
+
+using namespace std;
+
+#define AVAL 3.14
+#define BVAL 5.42
+#define TOL  1e-10
+
+// Rows of C checked against the generator
+#define CHECK_ROWS 16
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int p, double runtime)
+{
+    ofstream myfile;
+    myfile.open("stats_part4.csv", ios_base::app);
+    myfile.precision(8);
+    myfile << name
+           << "," << nb_threads << "," << n << "," << m << "," << p << "," << runtime << "\n";
+
+    myfile.close();
+}
+
+// Same schema as the part 2 generator variant, a GEMM is rows x cols with inner dimension P
+void write_generator_csv(const string &name, const generator &gen, bool on_the_fly, int nb_threads,
+                         int rows, int cols, int inner, int repeat, double init_time, double runtime)
+{
+    ofstream myfile;
+    myfile.open("stats_generator.csv", ios_base::app);
+    myfile.precision(8);
+    myfile << name << "," << gen.name() << "," << (on_the_fly ? "fly" : "fill")
+           << "," << nb_threads << "," << rows << "," << cols << "," << inner << "," << repeat
+           << "," << init_time << "," << runtime << "\n";
+
+    myfile.close();
+}
+
+double seconds(const struct timeval &begin, const struct timeval &end)
+{
+    return 1.0 * (end.tv_sec - begin.tv_sec) +
+           1.0e-6 * (end.tv_usec - begin.tv_usec);
+}
+
+// C[i][:] = sum over k of A[i][k] * B[k][:], A stored
+void multiplyStored(const double *A, const double *B, double *C, int Ndim, int Mdim, int Pdim)
+{
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < Ndim; i++) {
+        double *c = C + (size_t)i * Mdim;
+        for (int j = 0; j < Mdim; j++)
+            c[j] = 0;
+        for (int k = 0; k < Pdim; k++) {
+            double a = A[(size_t)i * Pdim + k];
+            const double *b = B + (size_t)k * Mdim;
+            #pragma omp simd
+            for (int j = 0; j < Mdim; j++)
+                c[j] += a * b[j];
+        }
+    }
+}
+
+// Same product with the row i of A evaluated into a private buffer, P
+// evaluations for P * M multiply-adds, and the k loop limited to the
+// columns of A that can be nonzero
+template <int KIND>
+void multiplyOnTheFly(const generator &genA, const double *B, double *C, int Ndim, int Mdim, int Pdim)
+{
+    #pragma omp parallel
+    {
+        vector<double> a(Pdim);
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < Ndim; i++) {
+            int kb = genA.col_begin(i), ke = genA.col_end(i, Pdim);
+            for (int k = kb; k < ke; k++)
+                a[k] = genA.at<KIND>(i, k);
+
+            double *c = C + (size_t)i * Mdim;
+            for (int j = 0; j < Mdim; j++)
+                c[j] = 0;
+            for (int k = kb; k < ke; k++) {
+                double aik = a[k];
+                const double *b = B + (size_t)k * Mdim;
+                #pragma omp simd
+                for (int j = 0; j < Mdim; j++)
+                    c[j] += aik * b[j];
+            }
+        }
+    }
+}
+
+void multiplyOnTheFly(const generator &genA, const double *B, double *C, int Ndim, int Mdim, int Pdim)
+{
+    switch (genA.kind) {
+    case GEN_RANDOM:
+        multiplyOnTheFly<GEN_RANDOM>(genA, B, C, Ndim, Mdim, Pdim);
+        break;
+    case GEN_BANDED:
+        multiplyOnTheFly<GEN_BANDED>(genA, B, C, Ndim, Mdim, Pdim);
+        break;
+    case GEN_TOEPLITZ:
+        multiplyOnTheFly<GEN_TOEPLITZ>(genA, B, C, Ndim, Mdim, Pdim);
+        break;
+    default:
+        multiplyOnTheFly<GEN_CONSTANT>(genA, B, C, Ndim, Mdim, Pdim);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int Ndim = 1000, Pdim = 1000, Mdim = 1000;   /* A[N][P], B[P][M], C[N][M] */
+    int nb_threads = omp_get_max_threads();
+    generator genA, genB;
+    bool on_the_fly = false;
+    bool freivalds_check = true;   /* else CHECK_ROWS rows recomputed */
+    double tol = -1;   /* Freivalds tolerance, freivalds_tolerance() when negative */
+    int trials = 2;
+
+    genA.value = AVAL;
+    genB.value = BVAL;
+
+    // Read command line arguments.
+    for (int i = 0; i < argc; i++) {
+        if ((strcmp(argv[i], "-N") == 0)) {
+            Ndim = atoi(argv[++i]);
+            printf("  User N is %d\n", Ndim);
+        } else if ((strcmp(argv[i], "-M") == 0)) {
+            Mdim = atoi(argv[++i]);
+            printf("  User M is %d\n", Mdim);
+        } else if ((strcmp(argv[i], "-P") == 0)) {
+            Pdim = atoi(argv[++i]);
+            printf("  User P is %d\n", Pdim);
+        } else if ((strcmp(argv[i], "-T") == 0)) {
+            nb_threads = atoi(argv[++i]);
+            omp_set_num_threads(nb_threads);
+            printf("  User num_threads is %d\n", nb_threads);
+        } else if ((strcmp(argv[i], "-gen") == 0)) {
+            genA.kind = genB.kind = parse_generator(argv[++i]);
+            printf("  User generator is %s\n", genA.name());
+        } else if ((strcmp(argv[i], "-mode") == 0)) {
+            i++;
+            if (strcmp(argv[i], "fill") == 0) {
+                on_the_fly = false;
+            } else if (strcmp(argv[i], "fly") == 0) {
+                on_the_fly = true;
+            } else {
+                printf("  Unknown mode %s (fill or fly)\n", argv[i]);
+                exit(1);
+            }
+            printf("  User mode is %s\n", argv[i]);
+        } else if ((strcmp(argv[i], "-seed") == 0)) {
+            genA.seed = strtoull(argv[++i], NULL, 10);
+            printf("  User seed is %llu\n", (unsigned long long)genA.seed);
+        } else if ((strcmp(argv[i], "-band") == 0)) {
+            genA.band = genB.band = atol(argv[++i]);
+            printf("  User band is %zu\n", genA.band);
+        } else if ((strcmp(argv[i], "-verify") == 0)) {
+            i++;
+            if (strcmp(argv[i], "freivalds") == 0) {
+                freivalds_check = true;
+            } else if (strcmp(argv[i], "rows") == 0) {
+                freivalds_check = false;
+            } else {
+                printf("  Unknown verification %s (freivalds or rows)\n", argv[i]);
+                exit(1);
+            }
+            printf("  User verification is %s\n", argv[i]);
+        } else if ((strcmp(argv[i], "-trials") == 0)) {
+            trials = atoi(argv[++i]);
+            if (trials < 1) {
+                printf("  The Freivalds check needs at least one trial\n");
+                exit(1);
+            }
+            printf("  User Freivalds trials is %d\n", trials);
+        } else if ((strcmp(argv[i], "-tol") == 0)) {
+            tol = atof(argv[++i]);
+            printf("  User Freivalds tolerance is %g\n", tol);
+        } else if ((strcmp(argv[i], "-pages") == 0)) {
+            huge_pages.mode = parse_page_mode(argv[++i]);
+            printf("  User pages are %s\n", page_mode_names[huge_pages.mode]);
+        } else if ((strcmp(argv[i], "-interleave") == 0)) {
+            huge_pages.interleave = true;
+            printf("  A, B and C are interleaved over the NUMA nodes\n");
+        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0)) {
+            printf("  Matrix multiplication Options:\n");
+            printf("  -N <int>:              Size of the dimension N (by default 1000)\n");
+            printf("  -M <int>:              Size of the dimension M (by default 1000)\n");
+            printf("  -P <int>:              Size of the dimension P (by default 1000)\n");
+            printf("  -T <int>:              Number of threads (by default the OpenMP default)\n");
+            printf("  -gen <name>:           A and B are constant, random, banded or toeplitz (by default constant)\n");
+            printf("  -mode <name>:          fill A before the product, or evaluate it on the fly (by default fill)\n");
+            printf("  -seed <int>:           seed of A for random and toeplitz, B uses seed + 1 (by default 42)\n");
+            printf("  -band <int>:           half width of the banded generator (by default 2)\n");
+            printf("  -verify <name>:        freivalds or rows, recomputes %d rows of C (by default freivalds)\n", CHECK_ROWS);
+            printf("  -trials <int>:         random vectors of the Freivalds check (by default 2)\n");
+            printf("  -tol <float>:          relative residual of the Freivalds check above which C is wrong\n");
+            printf("                         (by default 4 sqrt(M + P) u, u = 2^-53)\n");
+            printf("  -pages <name>:         pages of A, B and C, default, thp, 2m or 1g (by default default)\n");
+            printf("  -interleave:           interleave A, B and C over the NUMA nodes\n");
+            printf("  -help (-h):            print this message\n\n");
+            exit(1);
+        }
+    }
+    genB.seed = genA.seed + 1;
+
+    double *A = on_the_fly ? NULL : (double *)huge_alloc((size_t)Ndim * Pdim * sizeof(double));
+    double *B = (double *)huge_alloc((size_t)Pdim * Mdim * sizeof(double));
+    double *C = (double *)huge_alloc((size_t)Ndim * Mdim * sizeof(double));
+
+    /* Initialize matrices */
+
+    // Timer products.
+    struct timeval begin, end;
+
+    gettimeofday(&begin, NULL);
+
+    if (!on_the_fly)
+        generate(A, Ndim, Pdim, Pdim, genA);
+    generate(B, Pdim, Mdim, Mdim, genB);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < Ndim; i++)
+        for (int j = 0; j < Mdim; j++)
+            C[(size_t)i * Mdim + j] = 0.0;
+
+    gettimeofday(&end, NULL);
+    double init_time = seconds(begin, end);
+
+    /* Do the matrix product */
+
+    print_pages("A, B and C");
+    tlb_counter tlb;
+
+    tlb.start();
+    gettimeofday(&begin, NULL);
+
+    if (on_the_fly)
+        multiplyOnTheFly(genA, B, C, Ndim, Mdim, Pdim);
+    else
+        multiplyStored(A, B, C, Ndim, Mdim, Pdim);
+
+    gettimeofday(&end, NULL);
+    long long tlb_misses = tlb.stop();
+
+    // Calculate time.
+    double time = seconds(begin, end);
+
+    printf(" N %d M %d P %d initialization in %f seconds \n", Ndim, Mdim, Pdim, init_time);
+    printf(" N %d M %d P %d multiplication in %f seconds \n", Ndim, Mdim, Pdim, time);
+
+    double mflops = 2.0 * (double)Ndim * (double)Mdim * (double)Pdim / (1000000.0 * time);
+
+    printf(" N %d M %d P %d multiplication at %f mflops\n", Ndim, Mdim, Pdim, mflops);
+    print_tlb_misses(tlb_misses, 1);
+
+    /* Check the answer */
+
+    gettimeofday(&begin, NULL);
+
+    bool ok;
+    if (freivalds_check) {
+        double residual;
+        auto b = [&](size_t k, size_t j) { return B[k * Mdim + j]; };
+        if (on_the_fly)
+            residual = freivalds([&](size_t i, size_t k) { return genA(i, k); }, b, C, Ndim, Mdim, Pdim,
+                                 trials, genA.seed ^ 0x5eed);
+        else
+            residual = freivalds([&](size_t i, size_t k) { return A[i * Pdim + k]; }, b, C, Ndim, Mdim, Pdim,
+                                 trials, genA.seed ^ 0x5eed);
+        if (tol < 0)
+            tol = freivalds_tolerance(Mdim, Pdim, DBL_EPSILON / 2);
+        printf(" Freivalds relative residual %g (tolerance %g) over %d trials\n", residual, tol, trials);
+        ok = residual <= tol;
+    } else {
+        double max_err = 0, max_ref = 0;
+        vector<double> ref(Mdim);
+        for (int r = 0; r < CHECK_ROWS && r < Ndim; r++) {
+            int i = (int)((long)Ndim * r / min(CHECK_ROWS, Ndim));
+            fill(ref.begin(), ref.end(), 0.0);
+            for (int k = 0; k < Pdim; k++) {
+                double a = genA(i, k);
+                for (int j = 0; j < Mdim; j++)
+                    ref[j] += a * genB(k, j);
+            }
+            for (int j = 0; j < Mdim; j++) {
+                max_err = max(max_err, fabs(C[(size_t)i * Mdim + j] - ref[j]));
+                max_ref = max(max_ref, fabs(ref[j]));
+            }
+        }
+        ok = max_err <= TOL * max(1.0, max_ref);
+    }
+
+    gettimeofday(&end, NULL);
+    double verify_time = seconds(begin, end);
+    printf(" verification in %f seconds, %.2f%% of the multiplication\n", verify_time, 100 * verify_time / time);
+
+    if (!ok)
+        printf("\n Errors in multiplication");
+    else
+        printf("\n Hey, it worked");
+
+    string base = string("4_2 ") + genA.name() + (on_the_fly ? " fly" : " fill");
+    string name = base + huge_suffix();
+    write_perf_csv(name, nb_threads, Ndim, Mdim, Pdim, time);
+    write_pages_csv(base, nb_threads, Ndim, Mdim, Pdim, time, tlb_misses);
+    write_generator_csv(name, genA, on_the_fly, nb_threads, Ndim, Mdim, Pdim, 1, init_time, time);
+
+    huge_free(A, (size_t)Ndim * Pdim * sizeof(double));
+    huge_free(B, (size_t)Pdim * Mdim * sizeof(double));
+    huge_free(C, (size_t)Ndim * Mdim * sizeof(double));
+
+    printf("\n all done \n");
+    return 0;
+}
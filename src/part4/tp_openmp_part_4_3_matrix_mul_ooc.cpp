@@ -0,0 +1,548 @@
+/*
+**  PROGRAM: Matrix Multiply, out of core
+**
+**  PURPOSE: Computes the product
+**
+**                C  = A * B
+**
+**           with A, B and C in binary matrix files (the format of the part 2
+**           out of core variant) that do not have to fit in memory. C is
+**           computed tile by tile: for each tile of C, the tiles of A and B
+**           along P are read (mmap copies or pread), the read of the next
+**           pair is a task running while a taskloop multiplies the current
+**           one, and a finished tile of C is written back by a task while
+**           the next one is computed. The result is checked with Freivalds'
+**           algorithm on the files.
+**
+**  HISTORY: Written by Tim Mattson, Nov 1999.
+*            Modified and extended by Jonathan Rouzaud-Cornabas, Oct 2022
+*/
+
+
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../generator.hpp"
+#include "../freivalds.hpp"
+
+using namespace std;
+
+// Binary matrix file: a header padded to one page, then the rows as
+// doubles, row-major, so every row offset is known and the data is page aligned.
+#define MATRIX_MAGIC "TPOMPMAT"
+#define MATRIX_HEADER 4096
+
+// Rows of a tile of C per task of the taskloop
+#define GRAIN 8
+
+struct matrix_header {
+    char magic[8];
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t elem_size;
+};
+
+// Access modes, selected with -mode
+enum io_mode {
+    IO_MMAP,  // files mapped, tiles copied from and to the mappings
+    IO_PREAD  // tiles read with pread and written with pwrite, row by row
+};
+
+static const char *mode_names[] = {"mmap", "pread"};
+
+// A matrix file open for tiles, map is only set in mmap mode
+struct matrix_file {
+    int fd;
+    size_t rows, cols;
+    char *map;
+    size_t bytes;
+};
+
+double timeNow()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + 1.0e-6 * t.tv_usec;
+}
+
+// Writes a rows x cols matrix from a generator, a few rows at a time so it can exceed the memory
+void createMatrixFile(const char *file, size_t rows, size_t cols, const generator &gen)
+{
+    FILE *f = fopen(file, "wb");
+    if (f == NULL) {
+        perror("  fopen");
+        exit(1);
+    }
+    char header[MATRIX_HEADER] = {0};
+    matrix_header h;
+    memcpy(h.magic, MATRIX_MAGIC, 8);
+    h.rows = rows;
+    h.cols = cols;
+    h.elem_size = sizeof(double);
+    memcpy(header, &h, sizeof(h));
+    fwrite(header, 1, MATRIX_HEADER, f);
+
+    size_t chunk_rows = max((size_t)1, ((size_t)16 << 20) / (cols * sizeof(double)));
+    double *chunk = new double[chunk_rows * cols];
+    for (size_t i = 0; i < rows; i += chunk_rows) {
+        size_t n = min(chunk_rows, rows - i);
+        #pragma omp parallel for schedule(static)
+        for (size_t r = 0; r < n; r++)
+            for (size_t j = 0; j < cols; j++)
+                chunk[r * cols + j] = gen(i + r, j);
+        if (fwrite(chunk, sizeof(double) * cols, n, f) != n) {
+            perror("  fwrite");
+            exit(1);
+        }
+    }
+    delete[] chunk;
+    fclose(f);
+    printf("  Created %s, %zu x %zu %s\n", file, rows, cols, gen.name());
+}
+
+// Opens an existing matrix for reading, or creates a rows x cols one for
+// writing. In mmap mode the whole file is mapped.
+matrix_file openMatrixFile(const char *file, int mode, bool writable, size_t rows, size_t cols)
+{
+    matrix_file f;
+    f.fd = writable ? open(file, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(file, O_RDONLY);
+    if (f.fd < 0) {
+        perror("  open");
+        exit(1);
+    }
+    if (writable) {
+        char header[MATRIX_HEADER] = {0};
+        matrix_header h;
+        memcpy(h.magic, MATRIX_MAGIC, 8);
+        h.rows = rows;
+        h.cols = cols;
+        h.elem_size = sizeof(double);
+        memcpy(header, &h, sizeof(h));
+        if (pwrite(f.fd, header, MATRIX_HEADER, 0) != MATRIX_HEADER ||
+            ftruncate(f.fd, MATRIX_HEADER + rows * cols * sizeof(double)) != 0) {
+            perror("  write");
+            exit(1);
+        }
+    } else {
+        matrix_header h;
+        struct stat st;
+        if (pread(f.fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h.magic, MATRIX_MAGIC, 8) != 0 ||
+            h.elem_size != sizeof(double)) {
+            printf("  %s is not a matrix file of doubles\n", file);
+            exit(1);
+        }
+        fstat(f.fd, &st);
+        // A malformed header must not wrap the size below the file size
+        if (h.rows == 0 || h.cols == 0 || h.rows > (SIZE_MAX - MATRIX_HEADER) / sizeof(double) / h.cols) {
+            printf("  %s has an invalid size %llu x %llu\n", file, (unsigned long long)h.rows,
+                   (unsigned long long)h.cols);
+            exit(1);
+        }
+        if ((uint64_t)st.st_size < MATRIX_HEADER + h.rows * h.cols * sizeof(double)) {
+            printf("  %s is truncated\n", file);
+            exit(1);
+        }
+        rows = h.rows;
+        cols = h.cols;
+    }
+    f.rows = rows;
+    f.cols = cols;
+    f.bytes = MATRIX_HEADER + rows * cols * sizeof(double);
+    f.map = NULL;
+    if (mode == IO_MMAP) {
+        f.map = (char *)mmap(NULL, f.bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, f.fd, 0);
+        if (f.map == MAP_FAILED) {
+            perror("  mmap");
+            exit(1);
+        }
+    }
+    return f;
+}
+
+void closeMatrixFile(matrix_file &f)
+{
+    if (f.map != NULL)
+        munmap(f.map, f.bytes);
+    close(f.fd);
+}
+
+// Byte offset of element (i, j) in the file
+size_t offsetOf(const matrix_file &f, size_t i, size_t j)
+{
+    return MATRIX_HEADER + (i * f.cols + j) * sizeof(double);
+}
+
+// nr x nc tile at (r0, c0) into buf, ld doubles between the rows of buf
+void readTile(const matrix_file &f, double *buf, size_t ld, size_t r0, size_t c0, size_t nr, size_t nc)
+{
+    for (size_t r = 0; r < nr; r++) {
+        size_t offset = offsetOf(f, r0 + r, c0);
+        if (f.map != NULL) {
+            memcpy(buf + r * ld, f.map + offset, nc * sizeof(double));
+            continue;
+        }
+        char *dst = (char *)(buf + r * ld);
+        size_t bytes = nc * sizeof(double);
+        while (bytes > 0) {
+            ssize_t n = pread(f.fd, dst, bytes, offset);
+            if (n <= 0) {
+                perror("  pread");
+                exit(1);
+            }
+            dst += n;
+            bytes -= n;
+            offset += n;
+        }
+    }
+}
+
+// buf into the nr x nc tile at (r0, c0). With mmap the dirty pages of the
+// tile are handed to the writeback at once rather than at munmap.
+void writeTile(const matrix_file &f, const double *buf, size_t ld, size_t r0, size_t c0, size_t nr, size_t nc)
+{
+    for (size_t r = 0; r < nr; r++) {
+        size_t offset = offsetOf(f, r0 + r, c0);
+        if (f.map != NULL) {
+            memcpy(f.map + offset, buf + r * ld, nc * sizeof(double));
+            continue;
+        }
+        const char *src = (const char *)(buf + r * ld);
+        size_t bytes = nc * sizeof(double);
+        while (bytes > 0) {
+            ssize_t n = pwrite(f.fd, src, bytes, offset);
+            if (n <= 0) {
+                perror("  pwrite");
+                exit(1);
+            }
+            src += n;
+            bytes -= n;
+            offset += n;
+        }
+    }
+    if (f.map != NULL) {
+        size_t first = offsetOf(f, r0, c0) & ~(size_t)4095;
+        size_t last = offsetOf(f, r0 + nr - 1, c0 + nc);
+        msync(f.map + first, last - first, MS_ASYNC);
+    }
+}
+
+void write_perf_csv(const string &name, int nb_threads, int n, int m, int p, double runtime)
+{
+    ofstream myfile;
+    myfile.open("stats_part4.csv", ios_base::app);
+    myfile.precision(8);
+    myfile << name
+           << "," << nb_threads << "," << n << "," << m << "," << p << "," << runtime << "\n";
+
+    myfile.close();
+}
+
+void write_io_csv(const string &name, int nb_threads, size_t n, size_t m, size_t p, size_t tile, double runtime,
+                  double read_bandwidth, double write_bandwidth, double utilization, double reuse)
+{
+    ofstream myfile;
+    myfile.open("stats_part4_io.csv", ios_base::app);
+    myfile.precision(8);
+    myfile << name
+           << "," << nb_threads << "," << n << "," << m << "," << p << "," << tile << "," << runtime
+           << "," << read_bandwidth << "," << write_bandwidth << "," << utilization << "," << reuse << "\n";
+
+    myfile.close();
+}
+
+int main(int argc, char **argv)
+{
+    size_t Ndim = 2000, Pdim = 2000, Mdim = 2000;   /* A[N][P], B[P][M], C[N][M] */
+    int nb_threads = omp_get_max_threads();
+    size_t tile = 512;
+    int mode = IO_MMAP;
+    double tol = -1;   /* Freivalds tolerance, freivalds_tolerance() when negative */
+    int trials = 1;
+    bool create = false;
+    bool drop = false;   /* evict A and B from the page cache first */
+    const char *fileA = "A.bin", *fileB = "B.bin", *fileC = "C.bin";
+    generator genA, genB;
+
+    genA.kind = genB.kind = GEN_RANDOM;
+
+    // Read command line arguments.
+    for (int i = 0; i < argc; i++) {
+        if ((strcmp(argv[i], "-N") == 0)) {
+            Ndim = atol(argv[++i]);
+            printf("  User N is %zu\n", Ndim);
+        } else if ((strcmp(argv[i], "-M") == 0)) {
+            Mdim = atol(argv[++i]);
+            printf("  User M is %zu\n", Mdim);
+        } else if ((strcmp(argv[i], "-P") == 0)) {
+            Pdim = atol(argv[++i]);
+            printf("  User P is %zu\n", Pdim);
+        } else if ((strcmp(argv[i], "-T") == 0)) {
+            nb_threads = atoi(argv[++i]);
+            omp_set_num_threads(nb_threads);
+            printf("  User num_threads is %d\n", nb_threads);
+        } else if ((strcmp(argv[i], "-tile") == 0)) {
+            tile = atol(argv[++i]);
+            printf("  User tile is %zu\n", tile);
+        } else if ((strcmp(argv[i], "-mode") == 0)) {
+            i++;
+            if (strcmp(argv[i], "mmap") == 0) {
+                mode = IO_MMAP;
+            } else if (strcmp(argv[i], "pread") == 0) {
+                mode = IO_PREAD;
+            } else {
+                printf("  Unknown mode %s (mmap or pread)\n", argv[i]);
+                exit(1);
+            }
+            printf("  User mode is %s\n", argv[i]);
+        } else if ((strcmp(argv[i], "-create") == 0)) {
+            create = true;
+        } else if ((strcmp(argv[i], "-gen") == 0)) {
+            genA.kind = genB.kind = parse_generator(argv[++i]);
+            printf("  User generator is %s\n", genA.name());
+        } else if ((strcmp(argv[i], "-A") == 0)) {
+            fileA = argv[++i];
+        } else if ((strcmp(argv[i], "-B") == 0)) {
+            fileB = argv[++i];
+        } else if ((strcmp(argv[i], "-C") == 0)) {
+            fileC = argv[++i];
+        } else if ((strcmp(argv[i], "-drop") == 0)) {
+            drop = true;
+        } else if ((strcmp(argv[i], "-verify") == 0)) {
+            trials = atoi(argv[++i]);
+            printf("  User Freivalds trials is %d\n", trials);
+        } else if ((strcmp(argv[i], "-tol") == 0)) {
+            tol = atof(argv[++i]);
+            printf("  User Freivalds tolerance is %g\n", tol);
+        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-help") == 0)) {
+            printf("  Out of core matrix multiplication Options:\n");
+            printf("  -A, -B, -C <path>:     matrix files (by default A.bin, B.bin, C.bin)\n");
+            printf("  -create:               write A (N x P) and B (P x M) first\n");
+            printf("  -N <int>:              Size of the dimension N of the created files (by default 2000)\n");
+            printf("  -M <int>:              Size of the dimension M of the created files (by default 2000)\n");
+            printf("  -P <int>:              Size of the dimension P of the created files (by default 2000)\n");
+            printf("  -gen <name>:           values of the created files, constant, random, banded or toeplitz (by default random)\n");
+            printf("  -T <int>:              Number of threads (by default the OpenMP default)\n");
+            printf("  -tile <int>:           rows and columns of a tile (by default 512)\n");
+            printf("  -mode <name>:          mmap or pread (by default mmap)\n");
+            printf("  -drop:                 evict A and B from the page cache before the product\n");
+            printf("  -verify <int>:         Freivalds trials on the files, 0 to skip (by default 1)\n");
+            printf("  -tol <float>:          relative residual of the Freivalds check above which C is wrong\n");
+            printf("                         (by default 4 sqrt(M + P) u, u = 2^-53)\n");
+            printf("  -help (-h):            print this message\n\n");
+            exit(1);
+        }
+    }
+    if (tile == 0) {
+        printf("  The tile must be greater than 0.\n");
+        exit(1);
+    }
+    genB.seed = genA.seed + 1;
+
+    if (create) {
+        createMatrixFile(fileA, Ndim, Pdim, genA);
+        createMatrixFile(fileB, Pdim, Mdim, genB);
+    }
+    matrix_file A = openMatrixFile(fileA, mode, false, 0, 0);
+    matrix_file B = openMatrixFile(fileB, mode, false, 0, 0);
+    if (A.cols != B.rows) {
+        printf("  A is %zu x %zu and B %zu x %zu, they can not be multiplied\n", A.rows, A.cols, B.rows, B.cols);
+        exit(1);
+    }
+    Ndim = A.rows;
+    Pdim = A.cols;
+    Mdim = B.cols;
+    matrix_file C = openMatrixFile(fileC, mode, true, Ndim, Mdim);
+
+    if (drop) {
+        posix_fadvise(A.fd, 0, 0, POSIX_FADV_DONTNEED);
+        posix_fadvise(B.fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    // Two buffers per matrix: the tiles of A and B being read and the ones
+    // being multiplied, the tile of C being written back and the one computed
+    double *buffers[6];
+    for (int b = 0; b < 6; b++) {
+        buffers[b] = (double *)aligned_alloc(4096, (tile * tile * sizeof(double) + 4095) / 4096 * 4096);
+        if (buffers[b] == NULL) {
+            printf("  Cannot allocate the tiles\n");
+            exit(1);
+        }
+    }
+    double **Abuf = buffers, **Bbuf = buffers + 2, **Cbuf = buffers + 4;
+
+    size_t nbi = (Ndim + tile - 1) / tile, nbj = (Mdim + tile - 1) / tile, nbk = (Pdim + tile - 1) / tile;
+    size_t steps = nbi * nbj * nbk;
+    printf("  A %zu x %zu, B %zu x %zu, %zu x %zu x %zu tiles of %zu, %g MB of buffers\n", Ndim, Pdim, Pdim, Mdim,
+           nbi, nbj, nbk, tile, 6.0e-6 * tile * tile * sizeof(double));
+
+    double read_time = 0, write_time = 0, compute_time = 0;
+    size_t read_elems = 0;
+    /* dependences of the read and write tasks, only their addresses are used */
+    [[maybe_unused]] char load_tag[2], write_tag[2];
+
+    // Tile rows, columns and inner size of step s, C tiles in row order,
+    // the tiles along P innermost
+    auto stepOf = [&](size_t s, size_t &bi, size_t &bj, size_t &bk) {
+        bk = s % nbk;
+        bj = (s / nbk) % nbj;
+        bi = s / (nbk * nbj);
+    };
+    auto loadStep = [&](size_t s, int b) {
+        size_t bi, bj, bk;
+        stepOf(s, bi, bj, bk);
+        size_t nr = min(tile, Ndim - bi * tile), nm = min(tile, Mdim - bj * tile), nk = min(tile, Pdim - bk * tile);
+        double t0 = timeNow();
+        readTile(A, Abuf[b], tile, bi * tile, bk * tile, nr, nk);
+        readTile(B, Bbuf[b], tile, bk * tile, bj * tile, nk, nm);
+        double t = timeNow() - t0;
+        // One load task runs at a time, the next one is only created after
+        // the taskwait on this one; both totals are atomic all the same
+        #pragma omp atomic
+        read_time += t;
+        #pragma omp atomic
+        read_elems += nr * nk + nk * nm;
+    };
+
+    /* Do the matrix product */
+
+    // Timer products.
+    struct timeval begin, end;
+
+    gettimeofday(&begin, NULL);
+
+    #pragma omp parallel
+    #pragma omp single
+    {
+        loadStep(0, 0);
+        for (size_t s = 0; s < steps; s++) {
+            int b = s & 1;
+            size_t bi, bj, bk;
+            stepOf(s, bi, bj, bk);
+            size_t nr = min(tile, Ndim - bi * tile), nm = min(tile, Mdim - bj * tile), nk = min(tile, Pdim - bk * tile);
+            size_t ct = s / nbk;   /* tile of C */
+            double *c = Cbuf[ct & 1];
+
+            // The tiles of this step were read by the task of the previous one
+            #pragma omp taskwait depend(in : load_tag[b])
+            if (s + 1 < steps) {
+                #pragma omp task firstprivate(s) depend(out : load_tag[1 - b])
+                loadStep(s + 1, 1 - b);
+            }
+            // The buffer of C was written back two tiles ago
+            if (bk == 0) {
+                #pragma omp taskwait depend(in : write_tag[ct & 1])
+            }
+
+            const double *a = Abuf[b], *bt = Bbuf[b];
+            double t0 = timeNow();
+            #pragma omp taskloop grainsize(GRAIN)
+            for (size_t r = 0; r < nr; r++) {
+                double *crow = c + r * tile;
+                if (bk == 0)
+                    for (size_t j = 0; j < nm; j++)
+                        crow[j] = 0;
+                for (size_t k = 0; k < nk; k++) {
+                    double aik = a[r * tile + k];
+                    const double *brow = bt + k * tile;
+                    #pragma omp simd
+                    for (size_t j = 0; j < nm; j++)
+                        crow[j] += aik * brow[j];
+                }
+            }
+            compute_time += timeNow() - t0;
+
+            if (bk == nbk - 1) {
+                #pragma omp task firstprivate(c, bi, bj, nr, nm) depend(out : write_tag[ct & 1])
+                {
+                    double t1 = timeNow();
+                    writeTile(C, c, tile, bi * tile, bj * tile, nr, nm);
+                    double t = timeNow() - t1;
+                    #pragma omp atomic
+                    write_time += t;
+                }
+            }
+        }
+        #pragma omp taskwait
+    }
+
+    gettimeofday(&end, NULL);
+
+    // Calculate time.
+    double time = 1.0 * (end.tv_sec - begin.tv_sec) +
+                  1.0e-6 * (end.tv_usec - begin.tv_usec);
+
+    printf(" N %zu M %zu P %zu multiplication in %f seconds \n", Ndim, Mdim, Pdim, time);
+
+    double mflops = 2.0 * (double)Ndim * (double)Mdim * (double)Pdim / (1000000.0 * time);
+
+    printf(" N %zu M %zu P %zu multiplication at %f mflops\n", Ndim, Mdim, Pdim, mflops);
+
+    // Disk bandwidth seen by the read and write tasks, share of the run spent
+    // in the taskloops, and multiply-adds per element of A and B read
+    double read_gb = 1.0e-9 * read_elems * sizeof(double);
+    double write_gb = 1.0e-9 * Ndim * Mdim * sizeof(double);
+    double read_bandwidth = read_gb / read_time;
+    double write_bandwidth = write_gb / write_time;
+    double utilization = compute_time / time;
+    double reuse = (double)Ndim * Mdim * Pdim / read_elems;
+    printf(" read %g GB in %f s ( %g GB/s ), wrote %g GB in %f s ( %g GB/s )%s\n", read_gb, read_time,
+           read_bandwidth, write_gb, write_time, write_bandwidth,
+           drop ? "" : ", A and B may be cached (see -drop)");
+    printf(" compute %f s, utilization %.1f%%, tile reuse factor %g\n", compute_time, 100 * utilization, reuse);
+
+    string name = string("4_3 out of core ") + mode_names[mode];
+    write_perf_csv(name, nb_threads, Ndim, Mdim, Pdim, time);
+    write_io_csv(name, nb_threads, Ndim, Mdim, Pdim, tile, time, read_bandwidth, write_bandwidth, utilization,
+                 reuse);
+
+    for (int b = 0; b < 6; b++)
+        free(buffers[b]);
+    closeMatrixFile(A);
+    closeMatrixFile(B);
+    closeMatrixFile(C);
+
+    /* Check the answer */
+
+    if (trials > 0) {
+        matrix_file Am = openMatrixFile(fileA, IO_MMAP, false, 0, 0);
+        matrix_file Bm = openMatrixFile(fileB, IO_MMAP, false, 0, 0);
+        matrix_file Cm = openMatrixFile(fileC, IO_MMAP, false, 0, 0);
+        const double *a = (const double *)(Am.map + MATRIX_HEADER);
+        const double *bm = (const double *)(Bm.map + MATRIX_HEADER);
+        const double *cm = (const double *)(Cm.map + MATRIX_HEADER);
+
+        double t0 = timeNow();
+        double residual = freivalds([&](size_t i, size_t k) { return a[i * Pdim + k]; },
+                                    [&](size_t k, size_t j) { return bm[k * Mdim + j]; },
+                                    cm, Ndim, Mdim, Pdim, trials, 0x5eed);
+        if (tol < 0)
+            tol = freivalds_tolerance(Mdim, Pdim, DBL_EPSILON / 2);
+        printf(" Freivalds relative residual %g (tolerance %g) over %d trials in %f s\n", residual, tol, trials,
+               timeNow() - t0);
+        if (residual > tol)
+            printf("\n Errors in multiplication");
+        else
+            printf("\n Hey, it worked");
+
+        closeMatrixFile(Am);
+        closeMatrixFile(Bm);
+        closeMatrixFile(Cm);
+    }
+
+    printf("\n all done \n");
+    return 0;
+}
@@ -0,0 +1,374 @@
+/*
+**  PROGRAM: OMPT task tracer
+**
+**  PURPOSE: OMPT tool recording, for each thread, the explicit task
+**           creations and executions, the barriers / taskwaits and the
+**           time spent waiting in them without running any task (idle).
+**           At exit it writes a Chrome / Perfetto trace (chrome://tracing
+**           or ui.perfetto.dev) and appends a summary line per run.
+**
+**  USAGE:   libgomp has no OMPT support, the benchmarks have to run on the
+**           LLVM OpenMP runtime, which understands the GOMP_* entry points
+**           generated by g++:
+**
+**             g++ -shared -fPIC -O2 -o libompt_trace.so tools/tp_openmp_ompt_trace.cpp \
+**                 -I/usr/lib/llvm-14/lib/clang/14.0.6/include
+**             g++ -fopenmp -O3 -march=native -c part3/tp_openmp_part_3_1_fib.cpp -o fib.o
+**             g++ -o tp_openmp_part_3_1_fib fib.o -L/usr/lib/llvm-14/lib -lomp
+**             OMP_TOOL_LIBRARIES=./libompt_trace.so ./tp_openmp_part_3_1_fib -T 4
+**
+**           OMPT_TRACE_FILE    trace output (by default ompt_trace.json)
+**           OMPT_TRACE_SUMMARY summary csv, appended (by default stats_ompt.csv)
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <omp-tools.h>
+
+using namespace std;
+
+struct trace_event
+{
+   const char *name;
+   char ph;   // 'X' complete event, 'i' instant event
+   double ts; // us since the tool start
+   double dur;
+   uint64_t id;
+};
+
+// Attached to each explicit task through its ompt_data_t
+struct task_info
+{
+   uint64_t id;
+   double start;   // start of the current execution slice
+   double elapsed; // sum of the finished execution slices
+};
+
+struct thread_state
+{
+   int tid;
+   vector<trace_event> events;
+   double begin, end;
+
+   // Task currently executed by the thread and tasks waiting in a sync region,
+   // the thread is idle while the task on top of the wait stack is the current one
+   ompt_data_t *current;
+   vector<ompt_data_t *> waiting;
+   vector<double> wait_start;
+   double idle_start;
+   double idle;
+
+   uint64_t created;
+   uint64_t completed;
+   double task_time;
+};
+
+static chrono::steady_clock::time_point t0;
+// Never destroyed, the runtime finalizes the tool after the static destructors ran
+static mutex *threads_lock = new mutex();
+static vector<thread_state *> &threads = *new vector<thread_state *>();
+static thread_local thread_state *self = NULL;
+static atomic<uint64_t> next_task_id(1);
+
+static double now()
+{
+   return chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+}
+
+static bool is_idle(thread_state *t)
+{
+   return !t->waiting.empty() && t->waiting.back() == t->current;
+}
+
+// Ends the execution slice of the current explicit task, if any
+static void slice_end(thread_state *t, double ts)
+{
+   task_info *info = t->current != NULL ? (task_info *)t->current->ptr : NULL;
+   if (info != NULL && ts > info->start)
+   {
+      t->events.push_back({"task", 'X', info->start, ts - info->start, info->id});
+      info->elapsed += ts - info->start;
+   }
+}
+
+static void slice_begin(thread_state *t, double ts)
+{
+   task_info *info = t->current != NULL ? (task_info *)t->current->ptr : NULL;
+   if (info != NULL)
+      info->start = ts;
+}
+
+// Must be called around every change of current / waiting, a task idling
+// in a taskwait is not accounted as running
+static void idle_leave(thread_state *t, double ts)
+{
+   if (is_idle(t))
+   {
+      t->idle += ts - t->idle_start;
+      t->events.push_back({"idle", 'X', t->idle_start, ts - t->idle_start, 0});
+      slice_begin(t, ts);
+   }
+}
+
+static void idle_enter(thread_state *t, double ts)
+{
+   if (is_idle(t))
+   {
+      t->idle_start = ts;
+      slice_end(t, ts);
+   }
+}
+
+static const char *sync_name(ompt_sync_region_t kind)
+{
+   switch (kind)
+   {
+   case ompt_sync_region_barrier_explicit:
+      return "explicit barrier";
+   case ompt_sync_region_taskwait:
+      return "taskwait";
+   case ompt_sync_region_taskgroup:
+      return "taskgroup";
+   case ompt_sync_region_reduction:
+      return "reduction";
+   default:
+      return "implicit barrier";
+   }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Callbacks                                                              */
+/* ---------------------------------------------------------------------- */
+
+static void on_thread_begin(ompt_thread_t type, ompt_data_t *thread_data)
+{
+   thread_state *t = new thread_state();
+   t->begin = now();
+   t->end = t->begin;
+   {
+      lock_guard<mutex> guard(*threads_lock);
+      t->tid = threads.size();
+      threads.push_back(t);
+   }
+   thread_data->ptr = t;
+   self = t;
+}
+
+static void on_thread_end(ompt_data_t *thread_data)
+{
+   thread_state *t = (thread_state *)thread_data->ptr;
+   t->end = now();
+}
+
+static void on_implicit_task(ompt_scope_endpoint_t endpoint, ompt_data_t *parallel_data,
+                             ompt_data_t *task_data, unsigned int actual_parallelism,
+                             unsigned int index, int flags)
+{
+   thread_state *t = self;
+   if (t == NULL)
+      return;
+   double ts = now();
+   idle_leave(t, ts);
+   t->current = endpoint == ompt_scope_begin ? task_data : NULL;
+   idle_enter(t, ts);
+}
+
+static void on_task_create(ompt_data_t *encountering_task_data, const ompt_frame_t *encountering_task_frame,
+                           ompt_data_t *new_task_data, int flags, int has_dependences,
+                           const void *codeptr_ra)
+{
+   thread_state *t = self;
+   if (t == NULL || !(flags & ompt_task_explicit))
+      return;
+   task_info *info = new task_info();
+   info->id = next_task_id++;
+   new_task_data->ptr = info;
+   t->created++;
+   t->events.push_back({"task create", 'i', now(), 0, info->id});
+}
+
+static void on_task_schedule(ompt_data_t *prior_task_data, ompt_task_status_t prior_task_status,
+                             ompt_data_t *next_task_data)
+{
+   thread_state *t = self;
+   if (t == NULL)
+      return;
+   double ts = now();
+   idle_leave(t, ts);
+
+   // Implicit tasks carry no task_info, only explicit slices are recorded
+   task_info *prior = (task_info *)prior_task_data->ptr;
+   t->current = prior_task_data;
+   slice_end(t, ts);
+   if (prior != NULL && prior_task_status == ompt_task_complete)
+   {
+      t->completed++;
+      t->task_time += prior->elapsed;
+      delete prior;
+      prior_task_data->ptr = NULL;
+   }
+
+   t->current = next_task_data;
+   slice_begin(t, ts);
+   idle_enter(t, ts);
+}
+
+static void on_sync_region(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint,
+                           ompt_data_t *parallel_data, ompt_data_t *task_data,
+                           const void *codeptr_ra)
+{
+   thread_state *t = self;
+   if (t == NULL)
+      return;
+   double ts = now();
+   if (endpoint == ompt_scope_begin)
+   {
+      t->wait_start.push_back(ts);
+   }
+   else if (!t->wait_start.empty())
+   {
+      double start = t->wait_start.back();
+      t->wait_start.pop_back();
+      t->events.push_back({sync_name(kind), 'X', start, ts - start, 0});
+   }
+}
+
+static void on_sync_region_wait(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint,
+                                ompt_data_t *parallel_data, ompt_data_t *task_data,
+                                const void *codeptr_ra)
+{
+   thread_state *t = self;
+   if (t == NULL)
+      return;
+   double ts = now();
+   idle_leave(t, ts);
+   if (endpoint == ompt_scope_begin)
+   {
+      // The waiting task is the current one, task_data may be NULL at the
+      // end of a parallel region for some runtimes
+      t->waiting.push_back(t->current);
+   }
+   else if (!t->waiting.empty())
+   {
+      t->waiting.pop_back();
+   }
+   idle_enter(t, ts);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Output                                                                 */
+/* ---------------------------------------------------------------------- */
+
+static void write_trace(const char *path)
+{
+   FILE *f = fopen(path, "w");
+   if (f == NULL)
+   {
+      fprintf(stderr, "ompt_trace: cannot open %s: %s\n", path, strerror(errno));
+      return;
+   }
+   fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+   bool first = true;
+   for (thread_state *t : threads)
+   {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"omp thread %d\"}}",
+              first ? "" : ",\n", t->tid, t->tid);
+      first = false;
+      for (const trace_event &e : t->events)
+      {
+         if (e.ph == 'X')
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"omp\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"task\":%lu}}",
+                    e.name, t->tid, e.ts, e.dur, (unsigned long)e.id);
+         else
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"omp\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"task\":%lu}}",
+                    e.name, t->tid, e.ts, (unsigned long)e.id);
+      }
+   }
+   fprintf(f, "\n]}\n");
+   fclose(f);
+}
+
+static void write_summary(const char *path)
+{
+   double end = now();
+   uint64_t created = 0, completed = 0;
+   double task_time = 0, idle = 0, lifetime = 0;
+
+   fprintf(stderr, "ompt_trace: thread  created  completed  task time (ms)  idle (%%)\n");
+   for (thread_state *t : threads)
+   {
+      // Threads still alive at exit are still idling in the runtime
+      double t_end = t->end > t->begin ? t->end : end;
+      double t_life = t_end - t->begin;
+      created += t->created;
+      completed += t->completed;
+      task_time += t->task_time;
+      idle += t->idle;
+      lifetime += t_life;
+      fprintf(stderr, "ompt_trace: %6d %8lu %10lu %15.3f %9.2f\n", t->tid, (unsigned long)t->created,
+              (unsigned long)t->completed, t->task_time * 1e-3, t_life > 0 ? 100.0 * t->idle / t_life : 0.0);
+   }
+   double avg_task = completed > 0 ? task_time / completed : 0;
+   double idle_percent = lifetime > 0 ? 100.0 * idle / lifetime : 0;
+   fprintf(stderr, "ompt_trace: %lu tasks created, %lu completed, average task %.3f us, idle %.2f%%\n",
+           (unsigned long)created, (unsigned long)completed, avg_task, idle_percent);
+
+   ifstream exists(path);
+   bool header = !exists.good();
+   exists.close();
+   ofstream myfile;
+   myfile.open(path, ios_base::app);
+   myfile.precision(8);
+   if (header)
+      myfile << "program,nb_threads,tasks_created,tasks_completed,avg_task_us,idle_percent\n";
+   myfile << program_invocation_short_name
+          << "," << threads.size() << "," << created << "," << completed << "," << avg_task << "," << idle_percent << "\n";
+   myfile.close();
+}
+
+/* ---------------------------------------------------------------------- */
+/* Tool registration                                                      */
+/* ---------------------------------------------------------------------- */
+
+static int tool_initialize(ompt_function_lookup_t lookup, int initial_device_num, ompt_data_t *tool_data)
+{
+   ompt_set_callback_t set_callback = (ompt_set_callback_t)lookup("ompt_set_callback");
+   if (set_callback == NULL)
+      return 0;
+   t0 = chrono::steady_clock::now();
+
+   set_callback(ompt_callback_thread_begin, (ompt_callback_t)on_thread_begin);
+   set_callback(ompt_callback_thread_end, (ompt_callback_t)on_thread_end);
+   set_callback(ompt_callback_implicit_task, (ompt_callback_t)on_implicit_task);
+   set_callback(ompt_callback_task_create, (ompt_callback_t)on_task_create);
+   set_callback(ompt_callback_task_schedule, (ompt_callback_t)on_task_schedule);
+   set_callback(ompt_callback_sync_region, (ompt_callback_t)on_sync_region);
+   if (set_callback(ompt_callback_sync_region_wait, (ompt_callback_t)on_sync_region_wait) == ompt_set_never)
+      fprintf(stderr, "ompt_trace: sync_region_wait unsupported, idle time will be 0\n");
+
+   // Non zero keeps the tool active
+   return 1;
+}
+
+static void tool_finalize(ompt_data_t *tool_data)
+{
+   const char *trace = getenv("OMPT_TRACE_FILE");
+   const char *summary = getenv("OMPT_TRACE_SUMMARY");
+   lock_guard<mutex> guard(*threads_lock);
+   write_trace(trace != NULL ? trace : "ompt_trace.json");
+   write_summary(summary != NULL ? summary : "stats_ompt.csv");
+}
+
+extern "C" ompt_start_tool_result_t *ompt_start_tool(unsigned int omp_version, const char *runtime_version)
+{
+   static ompt_start_tool_result_t result = {&tool_initialize, &tool_finalize, {0}};
+   return &result;
+}